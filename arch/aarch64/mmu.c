@@ -0,0 +1,307 @@
+/*
+ * mmu.c - Identity-mapped MMU setup and cache control (AArch64)
+ *
+ * Same map and API as kernel/mm/mmu.c, built from VMSAv8-64 tables with
+ * a 4 KB granule and a 4 GB input range (T0SZ = 32, walks start at L1):
+ *   L1[0]  -> L2 table of 512 x 2 MB blocks
+ *             0x00000000 - 0x3EFFFFFF  normal RAM, write-back cacheable
+ *             0x3F000000 - 0x3FFFFFFF  peripherals, device
+ *   L1[1]  1 GB device block for the ARM local block at 0x40000000
+ *   L1[2-3] fault
+ *
+ * STACK_GUARD builds split the page pool's 2 MB blocks into L3 tables
+ * of 4 KB pages with the same attributes before the other cores start,
+ * so a guard page never has to replace a live block descriptor.
+ */
+
+#include "../../kernel/mm/mmu.h"
+#include "../../kernel/mm/page_alloc.h"
+#include "../../drivers/uart/uart.h"
+#include "../../kernel/sync/spin_lock.h"
+
+#define DESC_BLOCK      1ul
+#define DESC_TABLE      3ul             // Also the L3 page type
+#define DESC_TYPE_MASK  3ul
+#define DESC_ATTR(i)    ((uint64_t)(i) << 2)
+#define DESC_SH_INNER   (3ul << 8)
+#define DESC_AF         (1ul << 10)
+#define DESC_PXN        (1ul << 53)
+#define DESC_UXN        (1ul << 54)
+#define DESC_ADDR_MASK  0x0000FFFFFFFFF000ul
+
+// MAIR_EL1 slots
+#define ATTR_DEVICE     0               // Device-nGnRnE
+#define ATTR_NORMAL     1               // Normal, inner/outer WB RW-allocate
+#define MAIR_VALUE      ((0x00ul << (8 * ATTR_DEVICE)) | (0xFFul << (8 * ATTR_NORMAL)))
+
+#define NORMAL_FLAGS    (DESC_ATTR(ATTR_NORMAL) | DESC_SH_INNER | DESC_AF)
+#define DEVICE_FLAGS    (DESC_ATTR(ATTR_DEVICE) | DESC_AF | DESC_PXN | DESC_UXN)
+
+// TCR_EL1: T0SZ = 32, walks WB-WA inner shareable, 4 KB granule,
+// TTBR1 walks disabled, 32-bit physical addresses
+#define TCR_VALUE       (32ul | (1ul << 8) | (1ul << 10) | (3ul << 12) | (1ul << 23))
+
+#define BLOCK_2M        0x200000u
+#define L3_ENTRIES      512
+
+static uint64_t l1_table[4] __attribute__((aligned(4096)));
+static uint64_t l2_table[512] __attribute__((aligned(4096)));
+static Spinlock mmu_lock = SPINLOCK_INIT;
+
+#ifdef STACK_GUARD
+extern char __heap_start;
+
+// The pool's first block also holds the kernel and the boot stacks,
+// which cannot be unmapped for a split, so mmu_init splits it
+static uint64_t l3_heap_start[L3_ENTRIES] __attribute__((aligned(4096)));
+#endif
+
+// Implemented in cache.S
+extern void dcache_invalidate_all(void);
+
+static inline uint64_t sctlr_read(void) {
+    uint64_t val;
+    __asm__ __volatile__("mrs %0, sctlr_el1" : "=r"(val));
+    return val;
+}
+
+static inline void sctlr_write(uint64_t val) {
+    __asm__ __volatile__("msr sctlr_el1, %0" :: "r"(val) : "memory");
+    __asm__ __volatile__("isb" ::: "memory");
+}
+
+static uint32_t dcache_line_size(void) {
+    uint64_t ctr;
+    __asm__ __volatile__("mrs %0, ctr_el0" : "=r"(ctr));
+    return 4 << ((ctr >> 16) & 0xF);
+}
+
+/*
+ * Per-core part: clean caches/TLB, load the tables, enable. SMP
+ * coherency (CPUECTLR_EL1.SMPEN) is set by the firmware stub before
+ * it drops to us; EL1 cannot write it.
+ */
+static void mmu_enable(void) {
+    dcache_invalidate_all();
+    __asm__ __volatile__("ic iallu" ::: "memory");
+    __asm__ __volatile__("tlbi vmalle1" ::: "memory");
+    __asm__ __volatile__("dsb sy" ::: "memory");
+
+    __asm__ __volatile__("msr mair_el1, %0" :: "r"(MAIR_VALUE));
+    __asm__ __volatile__("msr tcr_el1, %0" :: "r"(TCR_VALUE));
+    __asm__ __volatile__("msr ttbr0_el1, %0" :: "r"((uint64_t)l1_table));
+    __asm__ __volatile__("isb" ::: "memory");
+
+    sctlr_write(sctlr_read() | SCTLR_M | SCTLR_C | SCTLR_I);
+}
+
+// Same mapping as 2 MB block idx, page by page
+static void l3_fill(uint64_t* l3, uint32_t idx) {
+    uint64_t base = (uint64_t)idx * BLOCK_2M;
+
+    for (uint32_t i = 0; i < L3_ENTRIES; i++) {
+        l3[i] = (base + ((uint64_t)i << 12)) | DESC_TABLE | NORMAL_FLAGS;
+    }
+}
+
+void mmu_init(void) {
+    for (uint32_t i = 0; i < 512; i++) {
+        uint64_t base = (uint64_t)i * BLOCK_2M;
+        l2_table[i] = base | DESC_BLOCK | (base < MMU_RAM_END ? NORMAL_FLAGS : DEVICE_FLAGS);
+    }
+
+#ifdef STACK_GUARD
+    // MMU still off: there is no live mapping to break
+    uint32_t idx = (uint64_t)&__heap_start / BLOCK_2M;
+    l3_fill(l3_heap_start, idx);
+    l2_table[idx] = (uint64_t)l3_heap_start | DESC_TABLE;
+#endif
+
+    l1_table[0] = (uint64_t)l2_table | DESC_TABLE;
+    l1_table[1] = 0x40000000ul | DESC_BLOCK | DEVICE_FLAGS;
+    l1_table[2] = 0;
+    l1_table[3] = 0;
+
+    mmu_enable();
+}
+
+void mmu_enable_secondary(void) {
+    mmu_enable();
+}
+
+// Translate a VA with AT S1E1R and return PAR_EL1 (bit 0 = fault)
+static uint64_t mmu_translate(uint64_t va) {
+    uint64_t par;
+    __asm__ __volatile__("at s1e1r, %0" :: "r"(va));
+    __asm__ __volatile__("isb" ::: "memory");
+    __asm__ __volatile__("mrs %0, par_el1" : "=r"(par));
+    return par;
+}
+
+static int mmu_check_va(const char* what, uint64_t va, uint32_t attr) {
+    uint64_t par = mmu_translate(va);
+    int ok = !(par & 1) &&
+             (par & DESC_ADDR_MASK) == (va & DESC_ADDR_MASK) &&
+             (par >> 56) == attr;
+
+    uart_puts("  ");
+    uart_puts(what);
+    uart_puts(" ");
+    uart_puthex((uint32_t)va);
+    uart_puts(" -> PAR ");
+    uart_puthex((uint32_t)par);
+    uart_puts(ok ? "  OK\n" : "  FAIL\n");
+    return ok ? 0 : -1;
+}
+
+int mmu_self_check(void) {
+    extern char __start;
+    int err = 0;
+    uint64_t sctlr = sctlr_read();
+
+    uart_puts("MMU self-check:\n");
+    uart_puts("  SCTLR_EL1 = ");
+    uart_puthex((uint32_t)sctlr);
+    uart_puts((sctlr & SCTLR_M) ? "  MMU on" : "  MMU OFF");
+    uart_puts((sctlr & SCTLR_C) ? ", D-cache on" : ", D-cache OFF");
+    uart_puts((sctlr & SCTLR_I) ? ", I-cache on\n" : ", I-cache OFF\n");
+    if ((sctlr & (SCTLR_M | SCTLR_C | SCTLR_I)) != (SCTLR_M | SCTLR_C | SCTLR_I)) {
+        err = -1;
+    }
+
+    // PAR attributes are the MAIR byte: 0xFF = WB-WA, 0x00 = device
+    err |= mmu_check_va("kernel", (uint64_t)&__start, 0xFF);
+    uint64_t sp;
+    __asm__ __volatile__("mov %0, sp" : "=r"(sp));
+    err |= mmu_check_va("stack ", sp, 0xFF);
+    err |= mmu_check_va("periph", 0x3F201000, 0x00);
+
+    // Cached write must be visible through a clean + invalidate
+    static volatile uint32_t probe[16] __attribute__((aligned(64)));
+    probe[0] = 0xC0FFEE01;
+    dcache_clean_range((const void*)probe, sizeof(probe));
+    dcache_invalidate_range((const void*)probe, sizeof(probe));
+    if (probe[0] != 0xC0FFEE01) {
+        uart_puts("  cache maintenance  FAIL\n");
+        err = -1;
+    }
+
+    uart_puts(err ? "MMU self-check FAILED\n" : "MMU self-check passed\n");
+    return err;
+}
+
+void dcache_clean_range(const void* start, uint32_t len) {
+    uint64_t line = dcache_line_size();
+    uint64_t addr = (uint64_t)start & ~(line - 1);
+    uint64_t end = (uint64_t)start + len;
+
+    for (; addr < end; addr += line) {
+        __asm__ __volatile__("dc cvac, %0" :: "r"(addr));
+    }
+    __asm__ __volatile__("dsb sy" ::: "memory");
+}
+
+void dcache_invalidate_range(const void* start, uint32_t len) {
+    uint64_t line = dcache_line_size();
+    uint64_t addr = (uint64_t)start & ~(line - 1);
+    uint64_t end = (uint64_t)start + len;
+
+    for (; addr < end; addr += line) {
+        __asm__ __volatile__("dc ivac, %0" :: "r"(addr));
+    }
+    __asm__ __volatile__("dsb sy" ::: "memory");
+}
+
+// Invalidate one VA in every core's TLB (inner shareable)
+static void tlb_invalidate_va(uint64_t va) {
+    __asm__ __volatile__("dsb ishst" ::: "memory");
+    __asm__ __volatile__("tlbi vaae1is, %0" :: "r"(va >> 12));
+    __asm__ __volatile__("dsb ish\n\tisb" ::: "memory");
+}
+
+int mmu_split_range(uint32_t start, uint32_t end) {
+    uint32_t flags = spin_lock_irqsave(&mmu_lock);
+
+    for (uint32_t idx = start / BLOCK_2M; idx < (end + BLOCK_2M - 1) / BLOCK_2M; idx++) {
+        uint64_t* l2e = &l2_table[idx];
+        if ((*l2e & DESC_TYPE_MASK) == DESC_TABLE) {
+            continue;
+        }
+        uint64_t* l3 = page_alloc(0);
+        if (!l3) {
+            spin_unlock_irqrestore(&mmu_lock, flags);
+            uart_puts("MMU: out of memory splitting blocks\n");
+            return -1;
+        }
+        l3_fill(l3, idx);
+        dcache_clean_range(l3, PAGE_SIZE);
+
+        // Break-before-make: the A53 may not hold the block and its
+        // pages in the TLB at once
+        *l2e = 0;
+        dcache_clean_range(l2e, sizeof(*l2e));
+        tlb_invalidate_va((uint64_t)idx * BLOCK_2M);
+        *l2e = (uint64_t)l3 | DESC_TABLE;
+        dcache_clean_range(l2e, sizeof(*l2e));
+        __asm__ __volatile__("isb" ::: "memory");
+    }
+
+    spin_unlock_irqrestore(&mmu_lock, flags);
+    return 0;
+}
+
+// Caller holds mmu_lock. The L3 table covering va, or 0 if its block
+// was never split.
+static uint64_t* l3_table_for(uint64_t va) {
+    uint64_t desc = l2_table[va / BLOCK_2M];
+
+    if ((desc & DESC_TYPE_MASK) != DESC_TABLE) {
+        return 0;
+    }
+    return (uint64_t*)(desc & DESC_ADDR_MASK);
+}
+
+static int mmu_set_page(void* page, int mapped) {
+    uint64_t va = (uint64_t)page;
+
+    if ((va & (PAGE_SIZE - 1)) || va >= MMU_RAM_END) {
+        return -1;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&mmu_lock);
+
+    uint64_t* l3 = l3_table_for(va);
+    if (!l3) {
+        spin_unlock_irqrestore(&mmu_lock, flags);
+        return -1;
+    }
+
+    uint64_t* pte = &l3[(va >> 12) & (L3_ENTRIES - 1)];
+    *pte = mapped ? (va | DESC_TABLE | NORMAL_FLAGS) : 0;
+    dcache_clean_range(pte, sizeof(*pte));
+    tlb_invalidate_va(va);
+
+    spin_unlock_irqrestore(&mmu_lock, flags);
+    return 0;
+}
+
+int mmu_guard_page(void* page) {
+    // Nothing cached may be written back into the page once it faults
+    dcache_clean_range(page, PAGE_SIZE);
+    dcache_invalidate_range(page, PAGE_SIZE);
+    return mmu_set_page(page, 0);
+}
+
+int mmu_unguard_page(void* page) {
+    return mmu_set_page(page, 1);
+}
+
+void cache_enable(void) {
+    __asm__ __volatile__("ic iallu" ::: "memory");
+    __asm__ __volatile__("dsb sy" ::: "memory");
+    sctlr_write(sctlr_read() | SCTLR_C | SCTLR_I);
+}
+
+int cache_enabled(void) {
+    return (sctlr_read() & SCTLR_C) != 0;
+}
@@ -2,7 +2,7 @@
 #include "../drivers/uart/uart.h"
 #include "../utils/string_utils.h"
 
-#define MAX_BLOCK_DEVICES 4
+#define MAX_BLOCK_DEVICES CONFIG_MAX_BLOCK_DEVICES
 
 static block_device_t *devices[MAX_BLOCK_DEVICES];
 static int device_count = 0;
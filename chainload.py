@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+
+#===========================================================================
+# SriOS Chainload Script - Push a kernel over UART0 (see kernel/chainload.h)
+#===========================================================================
+#
+# Usage: ./chainload.py [--baud N] [--reboot] [--term] PORT [IMAGE]
+#
+#   PORT     USB serial adapter (/dev/ttyUSB0) or the /dev/pts/N that
+#            `make qemu-pty` prints
+#   IMAGE    kernel.img (default) or kernel8.img
+#   --baud   transfer rate; default tries 3000000 down to 115200 and
+#            keeps the first one whose CRC checks out
+#   --reboot send `reboot warm` first, for a kernel already at its prompt
+#   --term   stay attached as a terminal afterwards (Ctrl-] quits)
+#
+# Standard library only. A pty ignores the baud rate, so under QEMU every
+# rate "works" and the first one on the ladder is used.
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+import zlib
+
+BOOT_BAUD = 115200
+MAGIC = b"SRCL"
+MAX_SIZE = 0x00800000
+LADDER = [3000000, 2000000, 1500000, 1000000, 921600, 460800, 230400, BOOT_BAUD]
+
+
+def set_baud(fd, baud):
+    attrs = termios.tcgetattr(fd)
+    speed = getattr(termios, "B%d" % baud)
+    attrs[4] = attrs[5] = speed
+    termios.tcsetattr(fd, termios.TCSADRAIN, attrs)
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    set_baud(fd, BOOT_BAUD)
+    return fd
+
+
+def read_until(fd, tokens, timeout, echo=False):
+    """Read until one of tokens shows up; returns (token, data) or (None, data)."""
+    buf = b""
+    deadline = time.monotonic() + timeout
+    while True:
+        for tok in tokens:
+            if tok in buf:
+                return tok, buf
+        left = deadline - time.monotonic()
+        if left <= 0:
+            return None, buf
+        r, _, _ = select.select([fd], [], [], left)
+        if not r:
+            return None, buf
+        data = os.read(fd, 4096)
+        if echo:
+            sys.stdout.buffer.write(data)
+            sys.stdout.flush()
+        buf += data
+
+
+def write_all(fd, data):
+    view = memoryview(data)
+    while view:
+        n = os.write(fd, view)
+        view = view[n:]
+
+
+def send(fd, image, baud, window_timeout):
+    """One attempt at one rate. True once the kernel has accepted the image."""
+    tok, _ = read_until(fd, [b"CHAINLOAD"], window_timeout, echo=True)
+    if tok is None:
+        sys.exit("chainload: no CHAINLOAD prompt (reset the board, or use --reboot)")
+
+    header = MAGIC + struct.pack("<III", len(image), zlib.crc32(image), baud)
+    write_all(fd, header)
+    tok, _ = read_until(fd, [b"OK", b"SZ"], 1.0)
+    if tok != b"OK":
+        sys.exit("chainload: kernel rejected the header (%s)" % tok)
+
+    set_baud(fd, baud)
+    tok, _ = read_until(fd, [b"GO"], 1.0)
+    if tok is None:
+        print("chainload: no GO at %d baud" % baud)
+        set_baud(fd, BOOT_BAUD)
+        return False
+
+    start = time.monotonic()
+    write_all(fd, image)
+    termios.tcdrain(fd)
+    took = time.monotonic() - start
+
+    tok, data = read_until(fd, [b"OK", b"CR", b"ER", b"TO"], 5.0)
+    if tok != b"OK":
+        print("chainload: %s at %d baud" % (tok.decode() if tok else "no reply", baud))
+        set_baud(fd, BOOT_BAUD)
+        return False
+
+    _, line = read_until(fd, [b"\n"], 1.0)
+    sys.stdout.write(line.decode(errors="replace").strip() + "\n")
+    print("chainload: host sent %d bytes in %.0f ms, %.0f KB/s"
+          % (len(image), took * 1000, len(image) / 1000 / max(took, 1e-6)))
+    set_baud(fd, BOOT_BAUD)
+    return True
+
+
+def terminal(fd):
+    print("chainload: terminal, Ctrl-] to quit")
+    old = termios.tcgetattr(sys.stdin)
+    tty.setraw(sys.stdin)
+    try:
+        while True:
+            r, _, _ = select.select([fd, sys.stdin], [], [])
+            if fd in r:
+                sys.stdout.buffer.write(os.read(fd, 4096))
+                sys.stdout.flush()
+            if sys.stdin in r:
+                data = os.read(sys.stdin.fileno(), 1024)
+                if b"\x1d" in data:
+                    break
+                write_all(fd, data)
+    finally:
+        termios.tcsetattr(sys.stdin, termios.TCSADRAIN, old)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Push a kernel to the SriOS serial chainloader")
+    ap.add_argument("port")
+    ap.add_argument("image", nargs="?", default="kernel.img")
+    ap.add_argument("--baud", type=int, help="fixed transfer rate")
+    ap.add_argument("--reboot", action="store_true", help="send `reboot warm` first")
+    ap.add_argument("--term", action="store_true", help="stay attached as a terminal")
+    args = ap.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if not image or len(image) > MAX_SIZE:
+        sys.exit("chainload: %s is %d bytes, limit %d" % (args.image, len(image), MAX_SIZE))
+    # The trampoline copies whole words
+    image += b"\0" * (-len(image) % 4)
+
+    fd = open_port(args.port)
+    if args.reboot:
+        write_all(fd, b"reboot warm\r")
+    else:
+        print("chainload: waiting for the board, reset it now")
+
+    # Not every host has termios constants for the top rates
+    ladder = [args.baud] if args.baud else [b for b in LADDER if hasattr(termios, "B%d" % b)]
+    for i, baud in enumerate(ladder):
+        # The first prompt may be a reset away; retries follow at once
+        if send(fd, image, baud, 60.0 if i == 0 else 5.0):
+            break
+    else:
+        sys.exit("chainload: giving up")
+
+    if args.term:
+        terminal(fd)
+    os.close(fd)
+
+
+if __name__ == "__main__":
+    main()
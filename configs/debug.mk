@@ -0,0 +1,20 @@
+# Development build: unoptimised, full driver chatter, every subsystem.
+# Same kernel the tree built before profiles existed.
+
+OPT = -O0
+GC_SECTIONS = n
+
+CONFIG_VERBOSE = y              # SD init steps, task creation, mount chatter
+CONFIG_FATFS = y                # FatFs, the mount initcall and ls/cat/...
+CONFIG_FF_READONLY = n          # Read-only FatFs drops touch/write/rm/mkdir
+CONFIG_FF_TINY = n              # One shared sector buffer instead of per file
+CONFIG_SD_TEST = y              # MBR dump at boot
+CONFIG_BENCH = y                # bench, bench mem/hot/sched/fair/idle
+CONFIG_CHAINLOAD = y            # Serial chainloader window at boot
+CONFIG_CHAINLOAD_WAIT_MS = 500
+
+CONFIG_TASK_STACK_SIZE = 4096   # Default for task_create / task_create_on
+CONFIG_TIMER_INTERVAL = 10000   # Scheduler tick, us
+CONFIG_TICKLESS = n             # Idle cores stop the tick; off keeps the old timing
+CONFIG_MAX_COMMANDS = 32
+CONFIG_MAX_BLOCK_DEVICES = 4
@@ -0,0 +1,21 @@
+# Smallest useful kernel: -Os, no filesystem, no chainloader, errors only.
+# Scheduler, memory management, SD block device and shell remain; bench
+# stays so `bench hot` can be compared across profiles.
+
+OPT = -Os
+GC_SECTIONS = y
+
+CONFIG_VERBOSE = n
+CONFIG_FATFS = n
+CONFIG_FF_READONLY = y
+CONFIG_FF_TINY = y
+CONFIG_SD_TEST = n
+CONFIG_BENCH = y
+CONFIG_CHAINLOAD = n
+CONFIG_CHAINLOAD_WAIT_MS = 0
+
+CONFIG_TASK_STACK_SIZE = 4096
+CONFIG_TIMER_INTERVAL = 10000
+CONFIG_TICKLESS = y
+CONFIG_MAX_COMMANDS = 20
+CONFIG_MAX_BLOCK_DEVICES = 1
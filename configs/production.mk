@@ -0,0 +1,21 @@
+# Shipping build: -O2, unused functions and data dropped at link time,
+# errors only on the console. Subsystems as in debug, without the
+# development tools: no benchmarks, no unauthenticated serial loader.
+
+OPT = -O2
+GC_SECTIONS = y
+
+CONFIG_VERBOSE = n
+CONFIG_FATFS = y
+CONFIG_FF_READONLY = n
+CONFIG_FF_TINY = n
+CONFIG_SD_TEST = n
+CONFIG_BENCH = n
+CONFIG_CHAINLOAD = n
+CONFIG_CHAINLOAD_WAIT_MS = 0
+
+CONFIG_TASK_STACK_SIZE = 4096
+CONFIG_TIMER_INTERVAL = 10000
+CONFIG_TICKLESS = y
+CONFIG_MAX_COMMANDS = 32
+CONFIG_MAX_BLOCK_DEVICES = 4
@@ -0,0 +1,56 @@
+#include "mailbox.h"
+#include "../../kernel/mm/mmu.h"
+
+// Cache-line aligned so maintenance never touches neighbouring data
+volatile uint32_t __attribute__((aligned(64))) mbox_buffer[32];
+
+static void mbox_delay(uint32_t count) {
+    for (volatile uint32_t i = 0; i < count; i++) {
+        __asm__ volatile("nop");
+    }
+}
+
+int mbox_call(uint8_t channel) {
+    uint32_t addr = ((uintptr_t)&mbox_buffer) & ~0xF;
+    
+    // GPU reads the buffer straight from RAM
+    dcache_clean_range((const void*)mbox_buffer, sizeof(mbox_buffer));
+    
+    // Wait until mailbox is not full
+    while (*MBOX_STATUS & MBOX_FULL) {
+        mbox_delay(1);
+    }
+    
+    // Write address + channel
+    *MBOX_WRITE = addr | channel;
+    
+    // Wait for response
+    while (1) {
+        while (*MBOX_STATUS & MBOX_EMPTY) {
+            mbox_delay(1);
+        }
+        if (*MBOX_READ == (addr | channel)) {
+            dcache_invalidate_range((const void*)mbox_buffer, sizeof(mbox_buffer));
+            return mbox_buffer[1] == 0x80000000;
+        }
+    }
+}
+
+int mbox_get_arm_memory(uint32_t* base, uint32_t* size) {
+    mbox_buffer[0] = 8 * 4;                     // Buffer size
+    mbox_buffer[1] = 0;                         // Request code
+    mbox_buffer[2] = MBOX_TAG_GET_ARM_MEMORY;
+    mbox_buffer[3] = 8;                         // Value buffer size
+    mbox_buffer[4] = 0;                         // Request size
+    mbox_buffer[5] = 0;                         // Base
+    mbox_buffer[6] = 0;                         // Size
+    mbox_buffer[7] = 0;                         // End tag
+
+    if (!mbox_call(MBOX_CHANNEL)) {
+        return -1;
+    }
+
+    *base = mbox_buffer[5];
+    *size = mbox_buffer[6];
+    return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * mailbox.h - VideoCore mailbox (property channel)
+ */
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stdint.h>
+
+#define MBOX_BASE       0x3F00B880
+#define MBOX_READ       ((volatile uint32_t*)(MBOX_BASE + 0x00))
+#define MBOX_STATUS     ((volatile uint32_t*)(MBOX_BASE + 0x18))
+#define MBOX_WRITE      ((volatile uint32_t*)(MBOX_BASE + 0x20))
+#define MBOX_FULL       0x80000000
+#define MBOX_EMPTY      0x40000000
+#define MBOX_CHANNEL    8  // Property channel
+
+// Property tags
+#define MBOX_TAG_GET_ARM_MEMORY   0x00010005
+#define MBOX_TAG_SET_POWER_STATE  0x00028001
+#define MBOX_TAG_GET_CLOCK_RATE   0x00030002
+
+// Shared request/response buffer (fill, then call mbox_call)
+extern volatile uint32_t mbox_buffer[32];
+
+// Returns 1 if the GPU answered with success
+int mbox_call(uint8_t channel);
+
+// ARM-visible RAM as reported by the firmware; returns 0 on success
+int mbox_get_arm_memory(uint32_t* base, uint32_t* size);
+
+#endif
@@ -6,6 +6,10 @@
 
 #include "sd.h"
 #include "../uart/uart.h"
+#include "../mailbox/mailbox.h"
+#include "../../kernel/scheduler/task.h"
+#include "../../kernel/interrupts/interrupts.h"
+#include <stdatomic.h>
 
 // EMMC registers at 0x3F300000
 #define EMMC_BASE       0x3F300000
@@ -70,15 +74,6 @@
 #define GPPUD           ((volatile uint32_t*)(GPIO_BASE + 0x94))
 #define GPPUDCLK1       ((volatile uint32_t*)(GPIO_BASE + 0x9C))
 
-// Mailbox for GPU communication
-#define MBOX_BASE       0x3F00B880
-#define MBOX_READ       ((volatile uint32_t*)(MBOX_BASE + 0x00))
-#define MBOX_STATUS     ((volatile uint32_t*)(MBOX_BASE + 0x18))
-#define MBOX_WRITE      ((volatile uint32_t*)(MBOX_BASE + 0x20))
-#define MBOX_FULL       0x80000000
-#define MBOX_EMPTY      0x40000000
-#define MBOX_CHANNEL    8  // Property channel
-
 // Commands
 #define CMD_GO_IDLE         0
 #define CMD_SEND_IF_COND    8
@@ -94,6 +89,11 @@
 #define CMD_SEND_REL_ADDR   3
 #define CMD_SELECT_CARD     7
 #define CMD_SEND_CSD        9
+#define CMD_SEND_STATUS     13
+
+// Card state in R1 bits 12:9
+#define R1_STATE(r)         (((r) >> 9) & 0xF)
+#define CARD_STATE_TRAN     4
 
 static uint32_t sd_rca = 0;
 static int sd_high_capacity = 0;
@@ -105,44 +105,139 @@ static void sd_delay(uint32_t count) {
     }
 }
 
+// Timer based so delays stay correct with caches on
 static void sd_delay_us(uint32_t us) {
-    sd_delay(us * 50);
+    uint32_t start = *SYSTIMER_CLO;
+    while ((*SYSTIMER_CLO - start) < us);
 }
 
-static void sd_delay_ms(uint32_t ms) {
-    sd_delay_us(ms * 1000);
+/*
+ * Data phase waits. A ready FIFO, the common case, costs one read.
+ * Otherwise a task spins for SD_DATA_SPIN_US, then sleeps until the EMMC
+ * interrupt or the block's deadline, a callback timer, wakes it. The
+ * storage core, callers before the scheduler and callers with IRQs off
+ * count 1 us polls instead. One transfer at a time, like the rest of
+ * the driver.
+ */
+#define SD_DATA_TIMEOUT_US  1000000
+#define SD_DATA_SPIN_US     50
+
+typedef struct {
+    Timer timer;
+    Task* task;             // 0: poll
+    volatile int expired;
+    uint32_t spins;
+} SdDeadline;
+
+static int sd_irq_on;
+static Task* volatile sd_waiter;
+static volatile int sd_event;       // Set before the waiter is woken
+
+void sd_irq_enable(void) {
+    *EMMC_IRPT_EN = 0;
+    sd_irq_on = 1;
 }
 
-// Mailbox property call - CRITICAL for getting SD card access!
-static volatile uint32_t __attribute__((aligned(16))) mbox_buffer[32];
+// The line is level: mask it until the waiter re-arms
+void sd_irq(void) {
+    *EMMC_IRPT_EN = 0;
+    atomic_thread_fence(memory_order_seq_cst);
+    Task* waiter = sd_waiter;
+    if (waiter) {
+        sd_event = 1;
+        task_wake(waiter);
+    }
+}
 
-static int mbox_call(uint8_t channel) {
-    uint32_t addr = ((uint32_t)&mbox_buffer) & ~0xF;
-    
-    // Wait until mailbox is not full
-    while (*MBOX_STATUS & MBOX_FULL) {
-        sd_delay(1);
+static void sd_deadline_fire(void* arg) {
+    SdDeadline* d = arg;
+    d->expired = 1;
+    sd_event = 1;
+    task_wake(d->task);
+}
+
+static void sd_deadline_start(SdDeadline* d) {
+    Task* self = task_current();
+
+    d->expired = 0;
+    d->spins = 0;
+    d->task = (self && sd_irq_on && irqs_enabled()) ? self : 0;
+    if (d->task) {
+        timer_add(&d->timer, sd_deadline_fire, d, SD_DATA_TIMEOUT_US / CONFIG_TIMER_INTERVAL + 1);
     }
-    
-    // Write address + channel
-    *MBOX_WRITE = addr | channel;
-    
-    // Wait for response
-    while (1) {
-        while (*MBOX_STATUS & MBOX_EMPTY) {
-            sd_delay(1);
+}
+
+// Must run before d goes out of scope
+static void sd_deadline_stop(SdDeadline* d) {
+    if (d->task) {
+        timer_cancel_sync(&d->timer);
+    }
+}
+
+// Wait for *reg & ready; irq is the INTERRUPT bit that signals it
+static int sd_data_wait(SdDeadline* d, volatile uint32_t* reg, uint32_t ready, uint32_t irq) {
+    uint32_t start = *SYSTIMER_CLO;
+
+    while (!(*reg & ready)) {
+        uint32_t err = *EMMC_INTERRUPT & INT_ERROR_MASK;
+        if (err) {
+            uart_puts("SD: Data error, IRQ=");
+            uart_puthex(err);
+            uart_puts("\n");
+            *EMMC_INTERRUPT = err;
+            return SD_ERROR;
+        }
+        if (d->expired) {
+            return SD_TIMEOUT;
+        }
+        if (!d->task) {
+            sd_delay_us(1);
+            if (++d->spins > SD_DATA_TIMEOUT_US) {
+                return SD_TIMEOUT;
+            }
+            continue;
+        }
+        if (*SYSTIMER_CLO - start < SD_DATA_SPIN_US) {
+            continue;
+        }
+
+        // An edge after the clear stays latched in INTERRUPT and raises
+        // the IRQ once enabled; the re-check covers one before it
+        sd_event = 0;
+        sd_waiter = d->task;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (reg != EMMC_INTERRUPT) {
+            *EMMC_INTERRUPT = irq;      // Stale ready from an earlier word
         }
-        if (*MBOX_READ == (addr | channel)) {
-            return mbox_buffer[1] == 0x80000000;
+        *EMMC_IRPT_EN = irq | INT_ERROR_MASK;
+        if (!(*reg & ready) && !d->expired) {
+            task_wait(&sd_event);
         }
+        *EMMC_IRPT_EN = 0;
+        sd_waiter = 0;
+    }
+    return SD_OK;
+}
+
+// From a task (the SD initcall) whole ticks are slept so other initcalls
+// run meanwhile; the rest, and any caller outside a task, spins
+static void sd_delay_ms(uint32_t ms) {
+    uint32_t us = ms * 1000;
+
+    if (task_current() && us >= CONFIG_TIMER_INTERVAL) {
+        uint32_t start = *SYSTIMER_CLO;
+        task_sleep(us / CONFIG_TIMER_INTERVAL);
+        uint32_t slept = *SYSTIMER_CLO - start;
+        us = slept < us ? us - slept : 0;
     }
+    sd_delay_us(us);
 }
 
 static int sd_power_on(void) {
     // Request power for SD card (device ID 0)
     mbox_buffer[0] = 8 * 4;          // Buffer size
     mbox_buffer[1] = 0;              // Request code
-    mbox_buffer[2] = 0x28001;        // Tag: Set power state
+    mbox_buffer[2] = MBOX_TAG_SET_POWER_STATE;
     mbox_buffer[3] = 8;              // Value buffer size
     mbox_buffer[4] = 8;              // Request size
     mbox_buffer[5] = 0;              // Device ID: SD card
@@ -154,9 +249,9 @@ static int sd_power_on(void) {
         return -1;
     }
     
-    uart_puts("SD: Power on result = ");
-    uart_puthex(mbox_buffer[6]);
-    uart_puts("\n");
+    log_puts("SD: Power on result = ");
+    log_puthex(mbox_buffer[6]);
+    log_puts("\n");
     
     return 0;
 }
@@ -165,7 +260,7 @@ static int sd_get_clock_rate(void) {
     // Get clock rate for EMMC
     mbox_buffer[0] = 8 * 4;
     mbox_buffer[1] = 0;
-    mbox_buffer[2] = 0x30002;        // Tag: Get clock rate
+    mbox_buffer[2] = MBOX_TAG_GET_CLOCK_RATE;
     mbox_buffer[3] = 8;
     mbox_buffer[4] = 4;
     mbox_buffer[5] = 1;              // Clock ID: EMMC
@@ -261,9 +356,9 @@ static int sd_set_clock(uint32_t freq) {
         base_clock = 41666666;  // Default
     }
     
-    uart_puts("SD: Base clock = ");
-    uart_puthex(base_clock);
-    uart_puts("\n");
+    log_puts("SD: Base clock = ");
+    log_puthex(base_clock);
+    log_puts("\n");
     
     // Disable clock
     uint32_t ctrl1 = *EMMC_CONTROL1;
@@ -276,9 +371,9 @@ static int sd_set_clock(uint32_t freq) {
     if (div < 2) div = 2;
     if (div > 0x3FF) div = 0x3FF;
     
-    uart_puts("SD: Clock divider = ");
-    uart_puthex(div);
-    uart_puts("\n");
+    log_puts("SD: Clock divider = ");
+    log_puthex(div);
+    log_puts("\n");
     
     // Set divider
     ctrl1 = *EMMC_CONTROL1;
@@ -303,14 +398,14 @@ static int sd_set_clock(uint32_t freq) {
         return SD_TIMEOUT;
     }
     
-    uart_puts("SD: Clock stable\n");
+    log_puts("SD: Clock stable\n");
     return SD_OK;
 }
 
 int sd_init(void) {
     int retries;
     
-    uart_puts("\n=== SD Card Init (EMMC) ===\n");
+    log_puts("\n=== SD Card Init (EMMC) ===\n");
     
     // CRITICAL: Power on SD card via mailbox
     if (sd_power_on() != 0) {
@@ -325,9 +420,9 @@ int sd_init(void) {
     
     // Check version
     uint32_t ver = (*EMMC_SLOTISR_VER >> 16) & 0xFF;
-    uart_puts("SD: EMMC version = ");
-    uart_puthex(ver);
-    uart_puts("\n");
+    log_puts("SD: EMMC version = ");
+    log_puthex(ver);
+    log_puts("\n");
     
     // Reset controller
     *EMMC_CONTROL0 = 0;
@@ -341,7 +436,7 @@ int sd_init(void) {
         uart_puts("SD: Reset timeout\n");
         return SD_TIMEOUT;
     }
-    uart_puts("SD: Controller reset OK\n");
+    log_puts("SD: Controller reset OK\n");
     
     // Setup clock and timeout
     *EMMC_CONTROL1 = C1_CLK_INTLEN | C1_TOUNIT_MAX;
@@ -361,31 +456,31 @@ int sd_init(void) {
     sd_delay_ms(100);
     
     // CMD0 - Go idle (no response expected)
-    uart_puts("SD: CMD0\n");
+    log_puts("SD: CMD0\n");
     *EMMC_ARG1 = 0;
     *EMMC_CMDTM = (CMD_GO_IDLE << 24);
     sd_delay_ms(50);
     *EMMC_INTERRUPT = INT_ALL_MASK;
     
     // CMD8 - Interface condition
-    uart_puts("SD: CMD8\n");
+    log_puts("SD: CMD8\n");
     int sd_v2 = 0;
     uint32_t cmd8 = (CMD_SEND_IF_COND << 24) | CMD_RSPNS_48;
     if (sd_send_cmd(cmd8, 0x1AA) == SD_OK) {
         uint32_t resp = *EMMC_RESP0;
-        uart_puts("SD: CMD8 resp = ");
-        uart_puthex(resp);
-        uart_puts("\n");
+        log_puts("SD: CMD8 resp = ");
+        log_puthex(resp);
+        log_puts("\n");
         if ((resp & 0xFFF) == 0x1AA) {
-            uart_puts("SD: v2.0 card detected\n");
+            log_puts("SD: v2.0 card detected\n");
             sd_v2 = 1;
         }
     } else {
-        uart_puts("SD: CMD8 failed (v1 card?)\n");
+        log_puts("SD: CMD8 failed (v1 card?)\n");
     }
     
     // ACMD41 - Send operating condition
-    uart_puts("SD: ACMD41 loop\n");
+    log_puts("SD: ACMD41 loop\n");
     retries = 100;
     uint32_t ocr = 0;
     uint32_t acmd41_arg = sd_v2 ? 0x40FF8000 : 0x00FF8000;
@@ -395,9 +490,9 @@ int sd_init(void) {
         if (sd_send_acmd(acmd41, acmd41_arg) == SD_OK) {
             ocr = *EMMC_RESP0;
             if (ocr & 0x80000000) {
-                uart_puts("SD: Card ready, OCR = ");
-                uart_puthex(ocr);
-                uart_puts("\n");
+                log_puts("SD: Card ready, OCR = ");
+                log_puthex(ocr);
+                log_puts("\n");
                 break;
             }
         }
@@ -410,10 +505,10 @@ int sd_init(void) {
     }
     
     sd_high_capacity = (ocr & 0x40000000) ? 1 : 0;
-    uart_puts(sd_high_capacity ? "SD: SDHC card\n" : "SD: SDSC card\n");
+    log_puts(sd_high_capacity ? "SD: SDHC card\n" : "SD: SDSC card\n");
     
     // CMD2 - Get CID
-    uart_puts("SD: CMD2\n");
+    log_puts("SD: CMD2\n");
     uint32_t cmd2 = (CMD_ALL_SEND_CID << 24) | CMD_RSPNS_136;
     if (sd_send_cmd(cmd2, 0) != SD_OK) {
         uart_puts("SD: CMD2 failed\n");
@@ -421,19 +516,19 @@ int sd_init(void) {
     }
     
     // CMD3 - Get RCA
-    uart_puts("SD: CMD3\n");
+    log_puts("SD: CMD3\n");
     uint32_t cmd3 = (CMD_SEND_REL_ADDR << 24) | CMD_RSPNS_48;
     if (sd_send_cmd(cmd3, 0) != SD_OK) {
         uart_puts("SD: CMD3 failed\n");
         return SD_ERROR;
     }
     sd_rca = *EMMC_RESP0 & 0xFFFF0000;
-    uart_puts("SD: RCA = ");
-    uart_puthex(sd_rca);
-    uart_puts("\n");
+    log_puts("SD: RCA = ");
+    log_puthex(sd_rca);
+    log_puts("\n");
     
     // CMD9 - Get CSD
-    uart_puts("SD: CMD9\n");
+    log_puts("SD: CMD9\n");
     uint32_t cmd9 = (CMD_SEND_CSD << 24) | CMD_RSPNS_136;
     if (sd_send_cmd(cmd9, sd_rca) == SD_OK) {
         uint32_t csd[4];
@@ -446,20 +541,20 @@ int sd_init(void) {
         if (csd_struct == 1) {
             uint32_t c_size = ((csd[2] & 0x3F) << 16) | ((csd[1] >> 16) & 0xFFFF);
             sd_total_sectors = (c_size + 1) * 1024;
-            uart_puts("SD: Sectors = ");
-            uart_puthex(sd_total_sectors);
-            uart_puts("\n");
+            log_puts("SD: Sectors = ");
+            log_puthex(sd_total_sectors);
+            log_puts("\n");
         }
     }
     
     // CMD7 - Select card
-    uart_puts("SD: CMD7\n");
+    log_puts("SD: CMD7\n");
     uint32_t cmd7 = (CMD_SELECT_CARD << 24) | CMD_RSPNS_48B;
     if (sd_send_cmd(cmd7, sd_rca) != SD_OK) {
         uart_puts("SD: CMD7 failed\n");
         return SD_ERROR;
     }
-    uart_puts("SD: Card selected\n");
+    log_puts("SD: Card selected\n");
     
     // Increase clock speed
     sd_set_clock(25000000);
@@ -467,7 +562,57 @@ int sd_init(void) {
     // Set block size
     *EMMC_BLKSIZECNT = 512;
     
-    uart_puts("=== SD Ready (EMMC) ===\n\n");
+    log_puts("=== SD Ready (EMMC) ===\n\n");
+    return SD_OK;
+}
+
+int sd_save_state(SdState* state) {
+    if (sd_rca == 0) {
+        return SD_ERROR;
+    }
+
+    state->rca = sd_rca;
+    state->high_capacity = sd_high_capacity;
+    state->sectors = sd_total_sectors;
+    state->control0 = *EMMC_CONTROL0;
+    state->control1 = *EMMC_CONTROL1;
+    return SD_OK;
+}
+
+int sd_resume(const SdState* state) {
+    uint32_t clk = C1_CLK_EN | C1_CLK_STABLE;
+
+    if (state->rca == 0) {
+        return SD_ERROR;
+    }
+
+    // The controller is not reset on a warm restart: still clocked as left?
+    if ((*EMMC_CONTROL1 & clk) != clk || *EMMC_CONTROL1 != state->control1) {
+        log_puts("SD: Controller state changed, full init\n");
+        return SD_ERROR;
+    }
+    *EMMC_CONTROL0 = state->control0;
+
+    *EMMC_IRPT_EN = 0;
+    *EMMC_IRPT_MASK = INT_ALL_MASK;
+    *EMMC_INTERRUPT = INT_ALL_MASK;
+
+    // CMD13 - card must answer at its RCA, selected and idle
+    uint32_t cmd13 = (CMD_SEND_STATUS << 24) | CMD_RSPNS_48;
+    if (sd_send_cmd(cmd13, state->rca) != SD_OK ||
+        R1_STATE(*EMMC_RESP0) != CARD_STATE_TRAN) {
+        log_puts("SD: Card not in transfer state, full init\n");
+        return SD_ERROR;
+    }
+
+    sd_rca = state->rca;
+    sd_high_capacity = state->high_capacity;
+    sd_total_sectors = state->sectors;
+    *EMMC_BLKSIZECNT = 512;
+
+    log_puts("SD: Resumed, RCA = ");
+    log_puthex(sd_rca);
+    log_puts("\n");
     return SD_OK;
 }
 
@@ -478,6 +623,7 @@ uint32_t sd_get_sector_count(void) {
 int sd_read(uint32_t sector, uint32_t count, uint8_t *buffer) {
     uint32_t addr = sd_high_capacity ? sector : (sector * 512);
     uint32_t *buf = (uint32_t *)buffer;
+    SdDeadline data = {0};
 
     for (uint32_t blk = 0; blk < count; blk++) {
         int timeout = 100000;
@@ -509,18 +655,20 @@ int sd_read(uint32_t sector, uint32_t count, uint8_t *buffer) {
         *EMMC_INTERRUPT = INT_CMD_DONE;
 
         uint32_t *dest = &buf[blk * 128];
-        for (int i = 0; i < 128; i++) {
-            timeout = 100000;
-            while (!(*EMMC_STATUS & SR_READ_AVAILABLE) && timeout--) {
-                sd_delay_us(1);
+        int status = SD_OK;
+        sd_deadline_start(&data);
+        for (int i = 0; i < 128 && status == SD_OK; i++) {
+            status = sd_data_wait(&data, EMMC_STATUS, SR_READ_AVAILABLE, INT_READ_RDY);
+            if (status == SD_OK) {
+                dest[i] = *EMMC_DATA;
             }
-            if (timeout <= 0) return SD_TIMEOUT;
-            dest[i] = *EMMC_DATA;
         }
-
-        timeout = 1000000;
-        while (!(*EMMC_INTERRUPT & INT_DATA_DONE) && timeout--) {
-            sd_delay_us(1);
+        if (status == SD_OK) {
+            status = sd_data_wait(&data, EMMC_INTERRUPT, INT_DATA_DONE, INT_DATA_DONE);
+        }
+        sd_deadline_stop(&data);
+        if (status != SD_OK) {
+            return status;
         }
         *EMMC_INTERRUPT = INT_DATA_DONE;
     }
@@ -531,6 +679,7 @@ int sd_read(uint32_t sector, uint32_t count, uint8_t *buffer) {
 int sd_write(uint32_t sector, uint32_t count, const uint8_t *buffer) {
     uint32_t addr = sd_high_capacity ? sector : (sector * 512);
     const uint32_t *buf = (const uint32_t *)buffer;
+    SdDeadline data = {0};
 
     for (uint32_t blk = 0; blk < count; blk++) {
         int timeout = 100000;
@@ -562,18 +711,20 @@ int sd_write(uint32_t sector, uint32_t count, const uint8_t *buffer) {
         *EMMC_INTERRUPT = INT_CMD_DONE;
 
         const uint32_t *src = &buf[blk * 128];
-        for (int i = 0; i < 128; i++) {
-            timeout = 100000;
-            while (!(*EMMC_STATUS & SR_WRITE_AVAILABLE) && timeout--) {
-                sd_delay_us(1);
+        int status = SD_OK;
+        sd_deadline_start(&data);
+        for (int i = 0; i < 128 && status == SD_OK; i++) {
+            status = sd_data_wait(&data, EMMC_STATUS, SR_WRITE_AVAILABLE, INT_WRITE_RDY);
+            if (status == SD_OK) {
+                *EMMC_DATA = src[i];
             }
-            if (timeout <= 0) return SD_TIMEOUT;
-            *EMMC_DATA = src[i];
         }
-
-        timeout = 1000000;
-        while (!(*EMMC_INTERRUPT & INT_DATA_DONE) && timeout--) {
-            sd_delay_us(1);
+        if (status == SD_OK) {
+            status = sd_data_wait(&data, EMMC_INTERRUPT, INT_DATA_DONE, INT_DATA_DONE);
+        }
+        sd_deadline_stop(&data);
+        if (status != SD_OK) {
+            return status;
         }
         *EMMC_INTERRUPT = INT_DATA_DONE;
     }
@@ -581,6 +732,7 @@ int sd_write(uint32_t sector, uint32_t count, const uint8_t *buffer) {
     return SD_OK;
 }
 
+#if CONFIG_SD_TEST
 void test_sd_read(){
     uart_puts("\n=== Reading MBR (sector 0) ===\n");
     
@@ -623,4 +775,5 @@ void test_sd_read(){
     } else {
         uart_puts("Read FAILED!\n");
     }
-}
\ No newline at end of file
+}
+#endif
@@ -18,10 +18,29 @@
 #define SD_TIMEOUT     -2
 #define SD_NOT_FOUND   -3
 
+// Card and controller state carried across a warm restart
+typedef struct {
+    uint32_t rca;           // 0 = card not initialized
+    uint32_t high_capacity;
+    uint32_t sectors;
+    uint32_t control0;      // Bus width / mode
+    uint32_t control1;      // Clock divider and enables
+} SdState;
+
 // Initialize SD card
 // Returns: SD_OK on success, error code on failure
 int sd_init(void);
 
+// Snapshot the state of an initialized card
+// Returns: SD_OK, or SD_ERROR if sd_init has not succeeded
+int sd_save_state(SdState* state);
+
+// Pick up a card left selected and clocked by a previous kernel instead
+// of enumerating it again. Checks the clock still runs and the card
+// answers CMD13 in transfer state.
+// Returns: SD_OK, or an error code (caller should fall back to sd_init)
+int sd_resume(const SdState* state);
+
 // Read sectors from SD card
 // sector: Starting sector number (LBA)
 // count: Number of sectors to read
@@ -39,7 +58,14 @@ int sd_write(uint32_t sector, uint32_t count, const uint8_t* buffer);
 // Get SD card size in sectors
 uint32_t sd_get_sector_count(void);
 
+// Data-phase waits in a task sleep on the EMMC interrupt once this has
+// run (interrupts_init); sd_irq is its handler, on core 0
+void sd_irq_enable(void);
+void sd_irq(void);
+
 void test_sd_write(void);
+#if CONFIG_SD_TEST
 void test_sd_read(void);
+#endif
 
 #endif
\ No newline at end of file
@@ -5,13 +5,18 @@
 
 #include "block.h"
 #include "../sd/sd.h"
+#include "sd_queue.h"
 
 static int sd_block_read(
     uint32_t lba,
     uint32_t count,
     uint8_t *buffer
 ) {
+#ifdef SD_SERVICE_CORE
+    return sd_queue_read(lba, count, buffer);
+#else
     return sd_read(lba, count, buffer);
+#endif
 }
 
 static int sd_block_write(
@@ -19,7 +24,11 @@ static int sd_block_write(
     uint32_t count,
     const uint8_t *buffer
 ) {
+#ifdef SD_SERVICE_CORE
+    return sd_queue_write(lba, count, buffer);
+#else
     return sd_write(lba, count, buffer);
+#endif
 }
 
 static uint32_t sd_block_sector_count(void) {
@@ -35,5 +44,8 @@ block_device_t sd_block_dev = {
 };
 
 void sd_block_init(void) {
+#ifdef SD_SERVICE_CORE
+    sd_queue_init();
+#endif
     block_register(&sd_block_dev);
 }
\ No newline at end of file
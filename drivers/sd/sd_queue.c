@@ -0,0 +1,173 @@
+#include "sd_queue.h"
+
+#ifdef SD_SERVICE_CORE
+
+#include "sd.h"
+#include "../uart/uart.h"
+#include "../../kernel/scheduler/task.h"
+#include "../../kernel/interrupts/interrupts.h"
+#include "../../kernel/smp/smp.h"
+#include "../../kernel/sync/spin_lock.h"
+#include <stdatomic.h>
+
+typedef struct {
+    uint32_t op;
+    uint32_t sector;
+    uint32_t count;
+    uint8_t* buffer;
+    int status;
+    Task* waiter;           // NULL before the scheduler runs
+    volatile int done;
+} sd_request_t;
+
+/*
+ * Single-producer/single-consumer ring. head and tail sit on their own
+ * cache lines so the two cores do not bounce one line between them.
+ */
+typedef struct {
+    atomic_uint head __attribute__((aligned(64)));   // Written by producer
+    atomic_uint tail __attribute__((aligned(64)));   // Written by consumer
+    sd_request_t* slots[SD_RING_SIZE] __attribute__((aligned(64)));
+} sd_ring_t;
+
+static sd_ring_t submit_ring;       // core 0 side -> storage core
+static sd_ring_t complete_ring;     // storage core -> core 0
+
+// Submitters may be several tasks/cores: serialize them into one producer
+static Spinlock submit_lock = SPINLOCK_INIT;
+
+static int ring_push(sd_ring_t* ring, sd_request_t* req) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail == SD_RING_SIZE) {
+        return 0;  // Full
+    }
+
+    ring->slots[head & (SD_RING_SIZE - 1)] = req;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+static sd_request_t* ring_pop(sd_ring_t* ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail == head) {
+        return 0;  // Empty
+    }
+
+    sd_request_t* req = ring->slots[tail & (SD_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return req;
+}
+
+void sd_queue_init(void) {
+    atomic_store(&submit_ring.head, 0);
+    atomic_store(&submit_ring.tail, 0);
+    atomic_store(&complete_ring.head, 0);
+    atomic_store(&complete_ring.tail, 0);
+    spin_init(&submit_lock);
+
+    // Completion IPIs arrive on core 0 mailbox 0
+    *LOCAL_MBOX_CNTL(0) = 1;
+
+    uart_puts("SD: I/O offloaded to core ");
+    uart_putdec(SD_SERVICE_CORE);
+    uart_puts("\n");
+}
+
+void sd_queue_complete(void) {
+    sd_request_t* req;
+
+    while ((req = ring_pop(&complete_ring)) != 0) {
+        // req lives on the waiter's stack: read it before releasing
+        Task* waiter = req->waiter;
+        req->done = 1;
+        if (waiter) {
+            task_wake(waiter);
+        }
+    }
+
+    // Storage core may be waiting for completion ring space
+    __asm__ __volatile__("dsb sy\n\tsev" ::: "memory");
+}
+
+static int sd_queue_submit(uint32_t op, uint32_t sector, uint32_t count, uint8_t* buffer) {
+    sd_request_t req;
+    int scheduled = scheduler_is_running();
+
+    // Storage core never came up: do the I/O here
+    if (!smp_core_online(SD_SERVICE_CORE)) {
+        return (op == SD_REQ_READ) ? sd_read(sector, count, buffer)
+                                   : sd_write(sector, count, buffer);
+    }
+
+    req.op = op;
+    req.sector = sector;
+    req.count = count;
+    req.buffer = buffer;
+    req.status = SD_ERROR;
+    req.waiter = scheduled ? task_current() : 0;
+    req.done = 0;
+
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&submit_lock);
+        int ok = ring_push(&submit_ring, &req);
+        spin_unlock_irqrestore(&submit_lock, flags);
+        if (ok) break;
+
+        // Ring full
+        if (scheduled) task_yield();
+    }
+    __asm__ __volatile__("dsb sy\n\tsev" ::: "memory");
+
+    if (scheduled) {
+        task_wait(&req.done);
+    } else {
+        // Early boot: IRQs are still off, reap completions ourselves
+        while (!req.done) {
+            uint32_t flags = irq_save();
+            sd_queue_complete();
+            irq_restore(flags);
+        }
+    }
+
+    return req.status;
+}
+
+int sd_queue_read(uint32_t sector, uint32_t count, uint8_t* buffer) {
+    return sd_queue_submit(SD_REQ_READ, sector, count, buffer);
+}
+
+int sd_queue_write(uint32_t sector, uint32_t count, const uint8_t* buffer) {
+    return sd_queue_submit(SD_REQ_WRITE, sector, count, (uint8_t*)buffer);
+}
+
+void sd_service_main(void) {
+    while (1) {
+        // IRQs stay masked here, so a warm restart is polled for
+        smp_poll_park();
+
+        sd_request_t* req = ring_pop(&submit_ring);
+
+        if (!req) {
+            // Submitters SEV after every push
+            __asm__ __volatile__("wfe");
+            continue;
+        }
+
+        if (req->op == SD_REQ_READ) {
+            req->status = sd_read(req->sector, req->count, req->buffer);
+        } else {
+            req->status = sd_write(req->sector, req->count, req->buffer);
+        }
+
+        while (!ring_push(&complete_ring, req)) {
+            __asm__ __volatile__("wfe");
+        }
+        smp_send_ipi(0, IPI_SD_COMPLETE);
+    }
+}
+
+#endif
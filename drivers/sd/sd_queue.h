@@ -0,0 +1,34 @@
+/*
+ * sd_queue.h - SD I/O offloaded to a dedicated storage core
+ *
+ * Built with SD_SERVICE_CORE defined (make SD_CORE=1). Callers push a
+ * request onto a lock-free SPSC submission ring and block; the storage
+ * core runs sd_read/sd_write and posts the request on a completion ring,
+ * then raises an IPI so core 0 can wake the waiter.
+ */
+
+#ifndef SD_QUEUE_H
+#define SD_QUEUE_H
+
+#include <stdint.h>
+
+// Ring capacity, must be a power of two
+#define SD_RING_SIZE    16
+
+#define SD_REQ_READ     0
+#define SD_REQ_WRITE    1
+
+// Set up rings and the completion IPI (core 0, before the first request)
+void sd_queue_init(void);
+
+// Submit and block until the storage core has finished
+int sd_queue_read(uint32_t sector, uint32_t count, uint8_t* buffer);
+int sd_queue_write(uint32_t sector, uint32_t count, const uint8_t* buffer);
+
+// Drain the completion ring (core 0, IRQs masked)
+void sd_queue_complete(void);
+
+// Storage core main loop, never returns
+void sd_service_main(void);
+
+#endif
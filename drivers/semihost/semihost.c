@@ -0,0 +1,68 @@
+/*
+ * semihost.c - ARM semihosting calls
+ *
+ * The operation goes in r0/w0 and a pointer to its argument block in
+ * r1/x1; the host returns the result in r0/x0. Arguments are register
+ * sized, so the blocks are arrays of uintptr_t on both ISAs.
+ */
+
+#include "semihost.h"
+
+#ifdef SEMIHOSTING
+
+#include "../../utils/string_utils.h"
+
+#define SYS_OPEN        0x01
+#define SYS_CLOSE       0x02
+#define SYS_WRITE       0x05
+#define SYS_EXIT        0x18
+
+#define OPEN_MODE_WB    5               // fopen() "wb"
+#define ADP_STOPPED_APPLICATION_EXIT    0x20026
+
+static uintptr_t semihost_call(uint32_t op, uintptr_t arg) {
+#if defined(__aarch64__)
+    register uintptr_t x0 __asm__("x0") = op;
+    register uintptr_t x1 __asm__("x1") = arg;
+    __asm__ __volatile__("hlt #0xf000" : "+r"(x0) : "r"(x1) : "memory");
+    return x0;
+#else
+    register uintptr_t r0 __asm__("r0") = op;
+    register uintptr_t r1 __asm__("r1") = arg;
+#if defined(__thumb__)
+    __asm__ __volatile__("svc #0xab" : "+r"(r0) : "r"(r1) : "memory");
+#else
+    __asm__ __volatile__("svc #0x123456" : "+r"(r0) : "r"(r1) : "memory");
+#endif
+    return r0;
+#endif
+}
+
+int semihost_open(const char* path) {
+    uintptr_t args[3] = { (uintptr_t)path, OPEN_MODE_WB, (uintptr_t)str_len(path) };
+    return (int)semihost_call(SYS_OPEN, (uintptr_t)args);
+}
+
+int semihost_write(int fd, const void* buf, uint32_t len) {
+    uintptr_t args[3] = { (uintptr_t)fd, (uintptr_t)buf, len };
+    // Returns the number of bytes NOT written
+    return semihost_call(SYS_WRITE, (uintptr_t)args) ? -1 : 0;
+}
+
+void semihost_close(int fd) {
+    uintptr_t args[1] = { (uintptr_t)fd };
+    semihost_call(SYS_CLOSE, (uintptr_t)args);
+}
+
+void semihost_exit(void) {
+#if defined(__aarch64__)
+    // A64 takes a block: reason, exit code
+    uintptr_t args[2] = { ADP_STOPPED_APPLICATION_EXIT, 0 };
+    semihost_call(SYS_EXIT, (uintptr_t)args);
+#else
+    semihost_call(SYS_EXIT, ADP_STOPPED_APPLICATION_EXIT);
+#endif
+    while (1);
+}
+
+#endif
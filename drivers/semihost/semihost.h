@@ -0,0 +1,27 @@
+/*
+ * semihost.h - ARM semihosting (host file I/O and exit under QEMU)
+ *
+ * Only usable when the kernel runs under a debugger or QEMU started with
+ * -semihosting; on the board the trap instruction is an exception. The
+ * code is built only with SEMIHOSTING defined (make SEMIHOSTING=1, or
+ * any PGO= build).
+ */
+
+#ifndef SEMIHOST_H
+#define SEMIHOST_H
+
+#include <stdint.h>
+
+#ifdef SEMIHOSTING
+
+// Host file handle or -1
+int semihost_open(const char* path);
+// Returns 0 once all len bytes are written
+int semihost_write(int fd, const void* buf, uint32_t len);
+void semihost_close(int fd);
+// Ends the QEMU process
+void semihost_exit(void) __attribute__((noreturn));
+
+#endif
+
+#endif
@@ -1,4 +1,7 @@
 #include "uart.h"
+#include "../../kernel/scheduler/task.h"
+#include "../../kernel/interrupts/interrupts.h"
+#include <stdatomic.h>
 
 // Pi Zero 2W peripheral base
 #define PERIPHERAL_BASE 0x3F000000
@@ -7,11 +10,19 @@
 #define UART0_BASE   (PERIPHERAL_BASE + 0x201000)
 #define UART0_DR     ((volatile unsigned int*)(UART0_BASE + 0x00))
 #define UART0_FR     ((volatile unsigned int*)(UART0_BASE + 0x18))
+#define UART0_FR_BUSY   (1 << 3)
 #define UART0_IBRD   ((volatile unsigned int*)(UART0_BASE + 0x24))
 #define UART0_FBRD   ((volatile unsigned int*)(UART0_BASE + 0x28))
 #define UART0_LCRH   ((volatile unsigned int*)(UART0_BASE + 0x2C))
 #define UART0_CR     ((volatile unsigned int*)(UART0_BASE + 0x30))
+#define UART0_IFLS   ((volatile unsigned int*)(UART0_BASE + 0x34))
+#define UART0_IMSC   ((volatile unsigned int*)(UART0_BASE + 0x38))
 #define UART0_ICR    ((volatile unsigned int*)(UART0_BASE + 0x44))
+#define UART0_FR_RXFE   (1 << 4)
+#define UART0_INT_RX    (1 << 4)    // RX FIFO at its trigger level
+#define UART0_INT_RT    (1 << 6)    // RX timeout: bytes below the level, line idle
+
+#define UART_CLOCK   48000000
 
 // GPIO
 #define GPIO_BASE    (PERIPHERAL_BASE + 0x200000)
@@ -19,6 +30,16 @@
 #define GPPUD        ((volatile unsigned int*)(GPIO_BASE + 0x94))
 #define GPPUDCLK0    ((volatile unsigned int*)(GPIO_BASE + 0x98))
 
+// Filled by uart_irq, emptied by uart_getc. The FIFO holds 16 bytes,
+// under 2 ms at 115200, so the ring absorbs a paste between reads.
+#define UART_RX_RING 256
+static volatile char rx_ring[UART_RX_RING];
+static volatile unsigned int rx_head;
+static volatile unsigned int rx_tail;
+static volatile int rx_irq;
+static volatile int rx_ready;           // task_wait condition
+static Task* volatile rx_waiter;
+
 // Delay function
 static void delay(int count) {
     for (volatile int i = 0; i < count; i++);
@@ -43,7 +64,8 @@ void uart_init(void) {
     delay(150);
     *GPPUDCLK0 = 0;
 
-    // Clear interrupts
+    // Clear interrupts (a warm restart may leave RX ones enabled)
+    *UART0_IMSC = 0;
     *UART0_ICR = 0x7FF;
 
     // Set baud rate to 115200
@@ -64,6 +86,23 @@ void uart_init(void) {
     uart_puts("\n");
 }
 
+// Same 48 MHz UART clock: divisor = clock / (16 * baud), in 1/64ths
+void uart_set_baud(unsigned int baud) {
+    unsigned int div = (4 * UART_CLOCK + baud / 2) / baud;
+
+    uart_flush();
+    *UART0_CR = 0;
+    *UART0_IBRD = div >> 6;
+    *UART0_FBRD = div & 0x3F;
+    // The divisor only latches on an LCRH write
+    *UART0_LCRH = (1 << 4) | (3 << 5);
+    *UART0_CR = (1 << 0) | (1 << 8) | (1 << 9);
+}
+
+void uart_flush(void) {
+    while (*UART0_FR & UART0_FR_BUSY);
+}
+
 void uart_putc(unsigned char c) {
     while (*UART0_FR & (1 << 5));
     *UART0_DR = c;
@@ -86,19 +125,107 @@ void uart_puthex(unsigned int num) {
     }
 }
 
+void uart_putdec(unsigned int num) {
+    char buf[10];
+    int i = 0;
+    do {
+        buf[i++] = '0' + (num % 10);
+        num /= 10;
+    } while (num > 0);
+    while (i > 0) {
+        uart_putc(buf[--i]);
+    }
+}
+
+void uart_rx_irq_enable(void) {
+    rx_head = 0;
+    rx_tail = 0;
+    *UART0_IFLS = 0;                    // RX at 1/8 full; RT catches the rest
+    *UART0_ICR = UART0_INT_RX | UART0_INT_RT;
+    *UART0_IMSC = UART0_INT_RX | UART0_INT_RT;
+    rx_irq = 1;
+}
+
+void uart_irq(void) {
+    while (!(*UART0_FR & UART0_FR_RXFE)) {
+        char c = (char)(*UART0_DR & 0xFF);
+        if (rx_head - rx_tail < UART_RX_RING) {     // Full: drop
+            rx_ring[rx_head % UART_RX_RING] = c;
+            atomic_thread_fence(memory_order_release);
+            rx_head++;
+        }
+    }
+    *UART0_ICR = UART0_INT_RX | UART0_INT_RT;
+
+    // Pairs with the fence in uart_getc: either the reader sees the new
+    // head, or this sees the reader registered
+    atomic_thread_fence(memory_order_seq_cst);
+    Task* waiter = rx_waiter;
+    if (waiter) {
+        rx_ready = 1;
+        task_wake(waiter);
+    }
+}
+
+static int rx_pop(char* c) {
+    if (rx_tail == rx_head) {
+        return 0;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    *c = rx_ring[rx_tail % UART_RX_RING];
+    rx_tail++;
+    return 1;
+}
+
 char uart_getc(void) {
-    while (*UART0_FR & (1 << 4));
-    return (char)(*UART0_DR & 0xFF);
+    char c;
+
+    if (!rx_irq) {
+        while (*UART0_FR & UART0_FR_RXFE);
+        return (char)(*UART0_DR & 0xFF);
+    }
+
+    while (!rx_pop(&c)) {
+        Task* self = task_current();
+        if (!self || !irqs_enabled()) {
+            // Cannot sleep: poll the FIFO too. With IRQs off on core 0
+            // uart_irq cannot race us for it.
+            if (!(*UART0_FR & UART0_FR_RXFE)) {
+                return (char)(*UART0_DR & 0xFF);
+            }
+            continue;
+        }
+        // Re-check once registered: a byte that came in before is
+        // already in the ring, one after sets rx_ready
+        rx_ready = 0;
+        rx_waiter = self;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (rx_tail == rx_head) {
+            task_wait(&rx_ready);
+        }
+        rx_waiter = 0;
+    }
+    return c;
 }
 
 int uart_getc_non_blocking(char* c) {
-    if (*UART0_FR & (1 << 4)) {
+    if (rx_irq) {
+        return rx_pop(c);
+    }
+    if (*UART0_FR & UART0_FR_RXFE) {
         return 0;
     }
     *c = (char)(*UART0_DR & 0xFF);
     return 1;
 }
 
+int uart_getc_raw(void) {
+    if (*UART0_FR & (1 << 4)) {
+        return -1;
+    }
+    return *UART0_DR & 0xFFF;
+}
+
 void uart_readline(char* buffer, int max_length) {
     int index = 0;
     while (index < max_length - 1) {
@@ -5,8 +5,31 @@ void uart_init(void);
 void uart_putc(unsigned char c);
 void uart_puts(const char* str);
 void uart_puthex(unsigned int num);
+void uart_putdec(unsigned int num);
 
+// Progress chatter, compiled out unless the profile sets CONFIG_VERBOSE.
+// Errors keep using uart_puts.
+#define log_puts(s)     do { if (CONFIG_VERBOSE) uart_puts(s); } while (0)
+#define log_puthex(n)   do { if (CONFIG_VERBOSE) uart_puthex(n); } while (0)
+#define log_putdec(n)   do { if (CONFIG_VERBOSE) uart_putdec(n); } while (0)
+
+// Reprogram the divisor (UART0 clock 48 MHz, so at most 3000000)
+void uart_set_baud(unsigned int baud);
+// Wait until the last byte has left the shift register
+void uart_flush(void);
+
+// Blocks; from a task with IRQs on and the RX interrupt on it sleeps,
+// otherwise it polls
 char uart_getc();
 int uart_getc_non_blocking(char* c);
+// Byte plus error flags (UART_RX_ERRORS), or -1 if the FIFO is empty.
+// Reads the FIFO directly, so only before uart_rx_irq_enable.
+int uart_getc_raw(void);
+
+// From here on uart_irq (core 0) drains the RX FIFO into a ring that
+// uart_getc reads. One reader at a time, on any core.
+void uart_rx_irq_enable(void);
+void uart_irq(void);
+#define UART_RX_ERRORS  0xF00   // Overrun, break, parity, framing
 void uart_readline(char* buffer, int max_length);
 #endif
\ No newline at end of file
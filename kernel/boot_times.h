@@ -0,0 +1,29 @@
+#ifndef BOOT_TIMES_H
+#define BOOT_TIMES_H
+
+#include <stdint.h>
+
+/*
+ * Boot timestamps, SYSTIMER_CLO values (us since the firmware started
+ * the system timer). Filled in by boot.S right after BSS is cleared.
+ * stub_entry and inflated are only valid when magic is BOOT_LZ4_MAGIC,
+ * i.e. the kernel was unpacked by boot/lz4_stub.S. restart is the value
+ * _start was entered with: WARM_MAGIC (warmboot.h) after `reboot warm`.
+ */
+
+#define BOOT_LZ4_MAGIC  0x4C5A3421      // "LZ4!"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t stub_entry;        // Compressed image loaded, stub running
+    uint32_t inflated;          // Kernel unpacked at 0x8000
+    uint32_t kernel_entry;      // _start of the kernel proper
+    uint32_t restart;
+} BootTimes;
+
+extern BootTimes boot_times;
+
+// One line: kernel entry time, plus load and inflate time for LZ4 images
+void boot_times_report(void);
+
+#endif
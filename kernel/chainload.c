@@ -0,0 +1,180 @@
+/*
+ * chainload.c - Receive a kernel over UART0 and boot it
+ *
+ * Runs from kernel_main before anything else is set up, with IRQs off
+ * and nothing allocated, so the staging area is free RAM. Bytes are
+ * polled straight from the PL011 FIFO; at 3 Mbaud one arrives every
+ * 3.3 us, far slower than this loop, and the CRC is only computed once
+ * the whole image is in.
+ */
+
+#include "chainload.h"
+#include "interrupts/interrupts.h"
+#include "../drivers/uart/uart.h"
+#include "../utils/string_utils.h"
+
+#define HEADER_TIMEOUT_US   100000
+#define BYTE_TIMEOUT_US     1000000
+#define SWITCH_DELAY_US     20000       // Lets the host change its baud
+
+// boot.S
+extern char chain_tramp[];
+extern char chain_tramp_end[];
+extern void chainload_exec(void* tramp, const void* image, uint32_t len);
+
+typedef struct {
+    uint32_t size;
+    uint32_t crc;
+    uint32_t baud;
+} chain_header_t;
+
+static void chain_delay_us(uint32_t us) {
+    uint32_t start = *SYSTIMER_CLO;
+    while ((*SYSTIMER_CLO - start) < us);
+}
+
+// Raw byte with error flags, or -1 after timeout_us of silence
+static int rx_byte(uint32_t timeout_us) {
+    uint32_t start = *SYSTIMER_CLO;
+    int c;
+
+    while ((c = uart_getc_raw()) < 0) {
+        if (*SYSTIMER_CLO - start >= timeout_us) {
+            return -1;
+        }
+    }
+    return c;
+}
+
+static int rx_word(uint32_t* word) {
+    uint32_t w = 0;
+
+    for (int i = 0; i < 4; i++) {
+        int c = rx_byte(HEADER_TIMEOUT_US);
+        if (c < 0 || (c & UART_RX_ERRORS)) {
+            return -1;
+        }
+        w |= (uint32_t)(c & 0xFF) << (8 * i);
+    }
+    *word = w;
+    return 0;
+}
+
+// Slide over incoming bytes until the magic shows up or the window ends
+static int rx_header(chain_header_t* hdr, uint32_t window_us) {
+    uint32_t start = *SYSTIMER_CLO;
+    uint32_t last4 = 0;
+
+    while (*SYSTIMER_CLO - start < window_us) {
+        int c = uart_getc_raw();
+        if (c < 0) {
+            continue;
+        }
+        last4 = (last4 >> 8) | ((uint32_t)(c & 0xFF) << 24);
+        if (last4 == CHAINLOAD_MAGIC) {
+            return (rx_word(&hdr->size) || rx_word(&hdr->crc) || rx_word(&hdr->baud)) ? -1 : 0;
+        }
+    }
+    return -1;
+}
+
+// CRC-32 (IEEE, reflected), same as zlib.crc32
+static uint32_t crc32(const uint8_t* p, uint32_t n) {
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+// One window. 0 = image staged and verified, -1 = no sender, -2 = failed.
+static int chainload_attempt(chain_header_t* hdr) {
+    uint8_t* dst = (uint8_t*)(uintptr_t)CHAINLOAD_STAGING;
+
+    uart_puts("CHAINLOAD\n");
+    if (rx_header(hdr, CHAINLOAD_WAIT_MS * 1000) < 0) {
+        return -1;
+    }
+
+    if (hdr->size == 0 || hdr->size > CHAINLOAD_MAX_SIZE ||
+        (hdr->baud && (hdr->baud < CHAINLOAD_BAUD_MIN || hdr->baud > CHAINLOAD_BAUD_MAX))) {
+        uart_puts("SZ");
+        return -2;
+    }
+    uart_puts("OK");
+
+    if (hdr->baud) {
+        uart_set_baud(hdr->baud);
+        chain_delay_us(SWITCH_DELAY_US);
+    }
+    uart_puts("GO");
+
+    const char* status = 0;
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < hdr->size; i++) {
+        int c = rx_byte(BYTE_TIMEOUT_US);
+        if (c < 0) {
+            status = "TO";
+            break;
+        }
+        if (c & UART_RX_ERRORS) {
+            status = "ER";
+        }
+        if (i == 0) {
+            start = *SYSTIMER_CLO;
+        }
+        dst[i] = (uint8_t)c;
+    }
+    uint32_t us = *SYSTIMER_CLO - start;
+
+    if (!status && crc32(dst, hdr->size) != hdr->crc) {
+        status = "CR";
+    }
+    if (status) {
+        uart_puts(status);
+        uart_flush();
+        uart_set_baud(CHAINLOAD_BAUD);
+        return -2;
+    }
+
+    uint32_t ms = us / 1000 ? us / 1000 : 1;
+    uart_puts("OK");
+    uart_puts("CHAINLOAD: ");
+    uart_putdec(hdr->size);
+    uart_puts(" bytes in ");
+    uart_putdec(ms);
+    uart_puts(" ms, ");
+    uart_putdec(hdr->size / ms);
+    uart_puts(" KB/s at ");
+    uart_putdec(hdr->baud ? hdr->baud : CHAINLOAD_BAUD);
+    uart_puts(" baud\n");
+    uart_flush();
+    return 0;
+}
+
+void chainload_wait(void) {
+    chain_header_t hdr;
+
+    if (CHAINLOAD_WAIT_MS == 0) {
+        return;
+    }
+
+    for (int attempt = 0; attempt < CHAINLOAD_ATTEMPTS; attempt++) {
+        int err = chainload_attempt(&hdr);
+        if (err == -1) {
+            return;             // Nobody there, boot from SD
+        }
+        if (err < 0) {
+            continue;           // The sender retries, usually slower
+        }
+
+        // The trampoline must sit clear of the image's destination
+        void* tramp = (void*)(uintptr_t)(CHAINLOAD_STAGING + CHAINLOAD_MAX_SIZE);
+        memcpy(tramp, chain_tramp, chain_tramp_end - chain_tramp);
+        chainload_exec(tramp, (const void*)(uintptr_t)CHAINLOAD_STAGING, hdr.size);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef CHAINLOAD_H
+#define CHAINLOAD_H
+
+#include <stdint.h>
+
+/*
+ * Serial chainloader. At boot the kernel opens a short window in which
+ * chainload.py can push a new kernel image over UART0. The image is
+ * staged in free RAM, CRC-checked, then copied over the running kernel
+ * by a trampoline and entered like a firmware boot. With no sender the
+ * boot carries on with the kernel from the SD card.
+ *
+ * Protocol, words little endian:
+ *   kernel  "CHAINLOAD\n"                  window open, 115200 baud
+ *   host    "SRCL" size crc32 baud         baud 0 = stay at 115200
+ *   kernel  "OK" | "SZ" (bad size or baud)
+ *           both switch to baud; the kernel waits 20 ms, then
+ *   kernel  "GO"
+ *   host    size bytes of image
+ *   kernel  "OK" and a rate line | "CR" (CRC) | "ER" (overrun or
+ *           framing error) | "TO" (timeout)
+ * After a failure the kernel drops back to 115200 and reopens the
+ * window, so the sender can retry at a lower rate.
+ */
+
+#define CHAINLOAD_WAIT_MS   CONFIG_CHAINLOAD_WAIT_MS    // 0 = no window
+#define CHAINLOAD_ATTEMPTS  8           // One per rate on chainload.py's ladder
+#define CHAINLOAD_MAGIC     0x4C435253  // "SRCL"
+#define CHAINLOAD_BAUD      115200
+#define CHAINLOAD_BAUD_MIN  9600
+#define CHAINLOAD_BAUD_MAX  3000000     // 48 MHz UART clock / 16
+
+// Free at boot: above the kernel image, below boot/lz4_stub.S's copy
+#define CHAINLOAD_STAGING   0x01000000
+#define CHAINLOAD_MAX_SIZE  0x00800000  // The trampoline goes right after
+
+// Offer the window; returns only if no valid image arrived
+void chainload_wait(void);
+
+#endif
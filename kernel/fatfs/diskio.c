@@ -47,10 +47,10 @@ DRESULT disk_write(
 
 DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
 {
-    uart_puts("disk_ioctl called\n");
-    uart_puts("cmd: ");
-    uart_puthex(cmd);
-    uart_puts("\n");
+    log_puts("disk_ioctl called\n");
+    log_puts("cmd: ");
+    log_puthex(cmd);
+    log_puts("\n");
     if (pdrv != 0) return RES_PARERR;
 
     switch (cmd) {
@@ -9,10 +9,7 @@
 extern "C" {
 #endif
 
-typedef unsigned char  BYTE;   /* 8-bit */
-typedef unsigned short WORD;   /* 16-bit */
-typedef unsigned int   UINT;   /* FATFS uses this for counts */
-typedef unsigned long  LBA_t;  /* Logical block address (sector index) */
+#include "ff.h"		/* BYTE, WORD, UINT and LBA_t, sized for the target */
 
 
 /* Status of Disk Functions */
@@ -0,0 +1,230 @@
+/*
+ * gcov.c - Minimal libgcov for the kernel
+ *
+ * Every instrumented object carries a gcov_info describing its counters,
+ * and a constructor that passes it to __gcov_init(). The kernel does not
+ * run constructors at boot; gcov_dump() runs them first, as they only
+ * link the records into a list and the counters are static.
+ *
+ * The structure layouts and the .gcda encoding follow GCC's gcov-io.h
+ * and change between compiler versions, hence the __GNUC__ tests. Only
+ * arc counters are written: the PGO build uses -fprofile-arcs without
+ * value profiling, so no other merge functions are ever set.
+ *
+ * This file is compiled without instrumentation (see Makefile).
+ */
+
+#include "gcov.h"
+
+#ifdef GCOV_PROFILE
+
+#include <stdint.h>
+#include "../../drivers/semihost/semihost.h"
+#include "../../drivers/uart/uart.h"
+
+#if __GNUC__ >= 14
+#define GCOV_COUNTERS   9
+#elif __GNUC__ >= 10
+#define GCOV_COUNTERS   8
+#elif __GNUC__ >= 7
+#define GCOV_COUNTERS   9
+#else
+#define GCOV_COUNTERS   10
+#endif
+
+// Record lengths count words before GCC 12 and bytes since
+#if __GNUC__ >= 12
+#define GCOV_UNIT_SIZE  4
+#else
+#define GCOV_UNIT_SIZE  1
+#endif
+
+#define GCOV_DATA_MAGIC             0x67636461  // "gcda"
+#define GCOV_TAG_FUNCTION           0x01000000
+#define GCOV_TAG_FUNCTION_LENGTH    3
+#define GCOV_TAG_COUNTER(n)         (0x01A10000 + ((n) << 17))
+#define GCOV_TAG_OBJECT_SUMMARY     0xA1000000  // GCC 9 on
+#define GCOV_TAG_SUMMARY_LENGTH     2
+#define GCOV_COUNTER_ARCS           0
+
+#define GCOV_BUF_WORDS  256
+
+typedef int64_t gcov_type;
+
+struct gcov_info;
+
+typedef struct {
+    uint32_t num;
+    gcov_type* values;
+} gcov_ctr_info_t;
+
+typedef struct {
+    const struct gcov_info* key;
+    uint32_t ident;
+    uint32_t lineno_checksum;
+    uint32_t cfg_checksum;
+    gcov_ctr_info_t ctrs[];     // One per counter kind with a merge function
+} gcov_fn_info_t;
+
+typedef struct gcov_info {
+    uint32_t version;
+    struct gcov_info* next;
+    uint32_t stamp;
+#if __GNUC__ >= 12
+    uint32_t checksum;
+#endif
+    const char* filename;
+    void (*merge[GCOV_COUNTERS])(gcov_type*, uint32_t);
+    uint32_t n_functions;
+    const gcov_fn_info_t* const* functions;
+} gcov_info_t;
+
+// Linker script: the instrumentation constructors
+extern void (*__init_array_start[])(void);
+extern void (*__init_array_end[])(void);
+
+static gcov_info_t* gcov_list;
+static int gcov_ctors_run;
+
+static uint32_t gcov_buf[GCOV_BUF_WORDS];
+static uint32_t gcov_fill;
+static int gcov_fd;
+static int gcov_err;
+static uint64_t gcov_sum_max;   // Largest arc count in the whole kernel
+
+void __gcov_init(gcov_info_t* info) {
+    info->next = gcov_list;
+    gcov_list = info;
+}
+
+// Referenced from every gcov_info and the destructors; the kernel never
+// merges with an old .gcda or exits through libgcov
+void __gcov_merge_add(gcov_type* counters, uint32_t n) {
+    (void)counters;
+    (void)n;
+}
+
+void __gcov_exit(void) {
+}
+
+static void gcov_flush(void) {
+    if (gcov_fill && semihost_write(gcov_fd, gcov_buf, gcov_fill * 4) < 0) {
+        gcov_err = 1;
+    }
+    gcov_fill = 0;
+}
+
+static void gcov_put(uint32_t word) {
+    if (gcov_fill == GCOV_BUF_WORDS) {
+        gcov_flush();
+    }
+    gcov_buf[gcov_fill++] = word;
+}
+
+// Records for functions from another unit (COMDAT copies) are left empty
+static int gcov_live(const gcov_info_t* info, const gcov_fn_info_t* fn) {
+    return fn && fn->key == info;
+}
+
+static void gcov_write_info(const gcov_info_t* info) {
+    gcov_put(GCOV_DATA_MAGIC);
+    gcov_put(info->version);
+    gcov_put(info->stamp);
+#if __GNUC__ >= 12
+    gcov_put(info->checksum);
+#endif
+#if __GNUC__ >= 9
+    // -fprofile-use scales hot/cold thresholds by this; one run
+    gcov_put(GCOV_TAG_OBJECT_SUMMARY);
+    gcov_put(GCOV_TAG_SUMMARY_LENGTH * GCOV_UNIT_SIZE);
+    gcov_put(1);
+    gcov_put((uint32_t)(gcov_sum_max > 0xFFFFFFFF ? 0xFFFFFFFF : gcov_sum_max));
+#endif
+
+    for (uint32_t f = 0; f < info->n_functions; f++) {
+        const gcov_fn_info_t* fn = info->functions[f];
+
+        gcov_put(GCOV_TAG_FUNCTION);
+        if (!gcov_live(info, fn)) {
+            gcov_put(0);
+            continue;
+        }
+        gcov_put(GCOV_TAG_FUNCTION_LENGTH * GCOV_UNIT_SIZE);
+        gcov_put(fn->ident);
+        gcov_put(fn->lineno_checksum);
+        gcov_put(fn->cfg_checksum);
+
+        const gcov_ctr_info_t* ctr = fn->ctrs;
+        for (uint32_t k = 0; k < GCOV_COUNTERS; k++) {
+            if (!info->merge[k]) {
+                continue;
+            }
+            gcov_put(GCOV_TAG_COUNTER(k));
+            gcov_put(ctr->num * 2 * GCOV_UNIT_SIZE);
+            for (uint32_t i = 0; i < ctr->num; i++) {
+                uint64_t v = (uint64_t)ctr->values[i];
+                gcov_put((uint32_t)v);
+                gcov_put((uint32_t)(v >> 32));
+            }
+            ctr++;
+        }
+    }
+}
+
+static void gcov_summarise(void) {
+    gcov_sum_max = 0;
+    for (const gcov_info_t* info = gcov_list; info; info = info->next) {
+        if (!info->merge[GCOV_COUNTER_ARCS]) {
+            continue;
+        }
+        for (uint32_t f = 0; f < info->n_functions; f++) {
+            const gcov_fn_info_t* fn = info->functions[f];
+            if (!gcov_live(info, fn)) {
+                continue;
+            }
+            // Arcs are the first counter kind, so ctrs[0]
+            for (uint32_t i = 0; i < fn->ctrs[0].num; i++) {
+                if ((uint64_t)fn->ctrs[0].values[i] > gcov_sum_max) {
+                    gcov_sum_max = fn->ctrs[0].values[i];
+                }
+            }
+        }
+    }
+}
+
+int gcov_dump(void) {
+    int written = 0;
+
+    if (!gcov_ctors_run) {
+        for (void (**ctor)(void) = __init_array_start; ctor < __init_array_end; ctor++) {
+            (*ctor)();
+        }
+        gcov_ctors_run = 1;
+    }
+    gcov_summarise();
+
+    for (const gcov_info_t* info = gcov_list; info; info = info->next) {
+        gcov_fd = semihost_open(info->filename);
+        if (gcov_fd < 0) {
+            uart_puts("GCOV: cannot open ");
+            uart_puts(info->filename);
+            uart_puts("\n");
+            continue;
+        }
+        gcov_err = 0;
+        gcov_fill = 0;
+        gcov_write_info(info);
+        gcov_flush();
+        semihost_close(gcov_fd);
+        if (gcov_err) {
+            uart_puts("GCOV: write failed for ");
+            uart_puts(info->filename);
+            uart_puts("\n");
+            continue;
+        }
+        written++;
+    }
+    return written;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef GCOV_H
+#define GCOV_H
+
+/*
+ * Freestanding runtime for -fprofile-arcs, the instrumentation half of
+ * `make pgo`. Built only with PGO=gen (which defines GCOV_PROFILE); the
+ * dump goes out over semihosting, so it needs QEMU with -semihosting.
+ */
+
+#ifdef GCOV_PROFILE
+
+// Write one .gcda per instrumented object, at the path GCC recorded
+// when compiling it. Returns the number of files written.
+int gcov_dump(void);
+
+#else
+
+#define gcov_dump()     0
+
+#endif
+
+#endif
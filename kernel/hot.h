@@ -0,0 +1,18 @@
+#ifndef HOT_H
+#define HOT_H
+
+/*
+ * Placement for the IRQ-to-switch path. linker.ld packs .text.hot and
+ * .data.hot at the front of .text and .data, cache-line aligned, so the
+ * path spans a few I-cache lines instead of being spread between init
+ * code. `make hot-report` lists what ended up there.
+ */
+
+// Functions run on every tick or switch
+#define HOT         __attribute__((section(".text.hot")))
+
+// Globals written on every tick or switch. Each gets its own 64-byte
+// line (CACHE_LINE_SIZE) so the writes do not false-share with neighbours.
+#define HOT_DATA    __attribute__((section(".data.hot"), aligned(64)))
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * initcall.c - Dependency-ordered initcalls and the boot log
+ *
+ * Descriptors come from the .initcall section (see linker.ld). Their
+ * dependency names are resolved once into bitmasks; workers then scan
+ * under init_lock for a pending call whose dependencies are all done.
+ * Failure propagates: anything depending on a failed or skipped call is
+ * skipped. If nothing is running and nothing is ready while calls are
+ * still pending, the rest form a cycle and are skipped too.
+ */
+
+#include "initcall.h"
+#include "../boot_times.h"
+#include "../warmboot.h"
+#include "../interrupts/interrupts.h"
+#include "../scheduler/task.h"
+#include "../smp/smp.h"
+#include "../sync/spin_lock.h"
+#include "../../drivers/uart/uart.h"
+#include "../../utils/string_utils.h"
+
+typedef enum {
+    INIT_PENDING = 0,
+    INIT_RUNNING,
+    INIT_DONE,
+    INIT_FAILED,
+    INIT_SKIPPED
+} init_state_t;
+
+typedef struct {
+    init_state_t state;
+    uint32_t deps;              // Bit i = depends on initcall i
+    uint32_t start;
+    uint32_t end;
+    uint32_t core;
+} init_status_t;
+
+typedef struct {
+    const char* name;
+    uint32_t start;
+    uint32_t end;
+} boot_phase_t;
+
+extern const initcall_t __initcall_start[];
+extern const initcall_t __initcall_end[];
+
+static init_status_t status[INITCALL_MAX];
+static uint32_t call_count;
+static uint32_t done_mask;
+static uint32_t bad_mask;       // Failed or skipped
+static Spinlock init_lock = SPINLOCK_INIT;
+
+static boot_phase_t phases[BOOT_PHASE_MAX];
+static uint32_t phase_count;
+
+static const char* const state_names[] = {
+    "pending", "running", "ok", "FAILED", "skipped"
+};
+
+static int initcall_find(const char* name, uint32_t len) {
+    for (uint32_t i = 0; i < call_count; i++) {
+        const char* n = __initcall_start[i].name;
+        if (str_len(n) == (int)len && str_startswith(name, n)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Dependency names -> bitmask; an unknown name fails the call up front
+static int initcall_resolve(uint32_t i) {
+    const char* p = __initcall_start[i].deps;
+
+    while (*(p = str_skip_spaces(p))) {
+        uint32_t len = 0;
+        while (p[len] && p[len] != ' ') {
+            len++;
+        }
+        int d = initcall_find(p, len);
+        if (d < 0 || d == (int)i) {
+            uart_puts("INIT: bad dependency for ");
+            uart_puts(__initcall_start[i].name);
+            uart_puts("\n");
+            return -1;
+        }
+        status[i].deps |= 1u << d;
+        p += len;
+    }
+    return 0;
+}
+
+// Caller holds init_lock. Skip everything downstream of a failure.
+static void initcall_propagate(void) {
+    int changed = 1;
+
+    while (changed) {
+        changed = 0;
+        for (uint32_t i = 0; i < call_count; i++) {
+            if (status[i].state == INIT_PENDING && (status[i].deps & bad_mask)) {
+                status[i].state = INIT_SKIPPED;
+                bad_mask |= 1u << i;
+                changed = 1;
+            }
+        }
+    }
+}
+
+static void init_worker(void) {
+    while (1) {
+        int pick = -1;
+        int cycle = 0;
+        uint32_t pending = 0;
+        uint32_t running = 0;
+
+        uint32_t flags = spin_lock_irqsave(&init_lock);
+        initcall_propagate();
+        for (uint32_t i = 0; i < call_count; i++) {
+            if (status[i].state == INIT_RUNNING) {
+                running++;
+            }
+            if (status[i].state != INIT_PENDING) {
+                continue;
+            }
+            pending++;
+            if (pick < 0 && (status[i].deps & ~done_mask) == 0) {
+                pick = i;
+            }
+        }
+        if (pick >= 0) {
+            status[pick].state = INIT_RUNNING;
+            status[pick].start = *SYSTIMER_CLO;
+            status[pick].core = cpu_id();
+        } else if (pending && !running) {
+            for (uint32_t i = 0; i < call_count; i++) {
+                if (status[i].state == INIT_PENDING) {
+                    status[i].state = INIT_SKIPPED;
+                    bad_mask |= 1u << i;
+                }
+            }
+            pending = 0;
+            cycle = 1;
+        }
+        spin_unlock_irqrestore(&init_lock, flags);
+
+        if (cycle) {
+            uart_puts("INIT: dependency cycle, remaining initcalls skipped\n");
+        }
+
+        if (pick >= 0) {
+            int err = __initcall_start[pick].fn();
+
+            flags = spin_lock_irqsave(&init_lock);
+            status[pick].end = *SYSTIMER_CLO;
+            status[pick].state = err ? INIT_FAILED : INIT_DONE;
+            if (err) {
+                bad_mask |= 1u << pick;
+            } else {
+                done_mask |= 1u << pick;
+            }
+            spin_unlock_irqrestore(&init_lock, flags);
+
+            if (err) {
+                uart_puts("INIT: ");
+                uart_puts(__initcall_start[pick].name);
+                uart_puts(" failed\n");
+            }
+            continue;
+        }
+
+        if (!pending) {
+            return;
+        }
+        // Waiting on a dependency running on another worker
+        task_sleep(1);
+    }
+}
+
+void initcall_start(void) {
+    call_count = __initcall_end - __initcall_start;
+    if (call_count > INITCALL_MAX) {
+        uart_puts("INIT: too many initcalls, extra ones ignored\n");
+        call_count = INITCALL_MAX;
+    }
+
+    for (uint32_t i = 0; i < call_count; i++) {
+        if (initcall_resolve(i) < 0) {
+            status[i].state = INIT_FAILED;
+            bad_mask |= 1u << i;
+        }
+    }
+
+    for (uint32_t w = 0; w < INIT_WORKERS && w < call_count; w++) {
+        task_create("init", init_worker, 1);
+    }
+}
+
+uint32_t bootlog_phase(const char* name, uint32_t start) {
+    uint32_t now = *SYSTIMER_CLO;
+
+    if (phase_count < BOOT_PHASE_MAX) {
+        phases[phase_count].name = name;
+        phases[phase_count].start = start;
+        phases[phase_count].end = now;
+        phase_count++;
+    }
+    return now;
+}
+
+static void bootlog_row(const char* name, uint32_t start, uint32_t end,
+                        int core, const char* state) {
+    uart_puts("  ");
+    uart_puts(name);
+    for (int pad = 10 - str_len(name); pad > 0; pad--) {
+        uart_putc(' ');
+    }
+    uart_putdec(start);
+    uart_puts("  ");
+    uart_putdec(end);
+    uart_puts("  ");
+    uart_putdec(end - start);
+    uart_puts("  ");
+    if (core >= 0) {
+        uart_putdec(core);
+    } else {
+        uart_puts("-");
+    }
+    uart_puts("  ");
+    uart_puts(state);
+    uart_puts("\n");
+}
+
+void bootlog_report(void) {
+    init_status_t snap[INITCALL_MAX];
+
+    uint32_t flags = spin_lock_irqsave(&init_lock);
+    for (uint32_t i = 0; i < call_count; i++) {
+        snap[i] = status[i];
+    }
+    spin_unlock_irqrestore(&init_lock, flags);
+
+    uart_puts("\n  Boot log (SYSTIMER_CLO, us)\n");
+    uart_puts("  Phase     Start  End  Took  Core  Status\n");
+
+    const WarmHandoff* restart = warmboot_handoff();
+    if (restart) {
+        bootlog_row("restart", restart->reboot_at, boot_times.kernel_entry, 0, "ok");
+    } else if (boot_times.magic == BOOT_LZ4_MAGIC) {
+        bootlog_row("load", 0, boot_times.stub_entry, -1, "ok");
+        bootlog_row("inflate", boot_times.stub_entry, boot_times.inflated, 0, "ok");
+    } else {
+        bootlog_row("load", 0, boot_times.kernel_entry, -1, "ok");
+    }
+    for (uint32_t i = 0; i < phase_count; i++) {
+        bootlog_row(phases[i].name, phases[i].start, phases[i].end, 0, "ok");
+    }
+
+    // Latest finisher among the initcalls ends the critical path
+    int last = -1;
+    for (uint32_t i = 0; i < call_count; i++) {
+        int finished = snap[i].state == INIT_DONE || snap[i].state == INIT_FAILED;
+        if (snap[i].state == INIT_PENDING || snap[i].state == INIT_SKIPPED) {
+            uart_puts("  ");
+            uart_puts(__initcall_start[i].name);
+            uart_puts("  ");
+            uart_puts(state_names[snap[i].state]);
+            uart_puts("\n");
+            continue;
+        }
+        bootlog_row(__initcall_start[i].name, snap[i].start,
+                    snap[i].state == INIT_RUNNING ? *SYSTIMER_CLO : snap[i].end,
+                    snap[i].core, state_names[snap[i].state]);
+        if (finished && (last < 0 || snap[i].end > snap[last].end)) {
+            last = i;
+        }
+    }
+
+    // Walk back through the dependency that finished last at each step
+    int path[INITCALL_MAX];
+    int len = 0;
+    for (int i = last; i >= 0 && len < INITCALL_MAX; ) {
+        path[len++] = i;
+        int pred = -1;
+        for (uint32_t d = 0; d < call_count; d++) {
+            if ((snap[i].deps & (1u << d)) && (pred < 0 || snap[d].end > snap[pred].end)) {
+                pred = d;
+            }
+        }
+        i = pred;
+    }
+
+    uart_puts("\n  Critical path: ");
+    uart_puts(restart ? "restart" :
+              boot_times.magic == BOOT_LZ4_MAGIC ? "load -> inflate" : "load");
+    for (uint32_t i = 0; i < phase_count; i++) {
+        uart_puts(" -> ");
+        uart_puts(phases[i].name);
+    }
+    while (len > 0) {
+        uart_puts(" -> ");
+        uart_puts(__initcall_start[path[--len]].name);
+    }
+    // The shell runs as soon as the scheduler starts
+    uint32_t origin = restart ? restart->reboot_at : 0;
+    uint32_t prompt = phase_count ? phases[phase_count - 1].end : boot_times.kernel_entry;
+    uart_puts("\n  Time to prompt ");
+    uart_putdec(prompt - origin);
+    uart_puts(" us, to initcalls done ");
+    uart_putdec((last >= 0 ? snap[last].end : prompt) - origin);
+    uart_puts(restart ? " us (since `reboot warm`)\n\n" : " us (since power-on)\n\n");
+}
@@ -0,0 +1,43 @@
+#ifndef INITCALL_H
+#define INITCALL_H
+
+#include <stdint.h>
+
+/*
+ * Declarative boot-time initialisation.
+ *
+ * INITCALL() puts a descriptor in the .initcall section. Once the
+ * scheduler is up, INIT_WORKERS tasks take any call whose dependencies
+ * have all finished, so independent inits overlap and the shell does
+ * not wait for them. A call whose dependency failed is skipped.
+ *
+ * Each call, and every phase kernel_main records with bootlog_phase(),
+ * is timestamped from SYSTIMER_CLO for the `bootlog` command.
+ */
+
+#define INIT_WORKERS    3
+#define INITCALL_MAX    32
+#define BOOT_PHASE_MAX  8
+
+typedef int (*initcall_fn_t)(void);    // 0 = success
+
+typedef struct {
+    const char* name;
+    initcall_fn_t fn;
+    const char* deps;           // Space-separated initcall names, "" if none
+} initcall_t;
+
+#define INITCALL(id, func, dep_names)                                   \
+    static const initcall_t initcall_##id                               \
+    __attribute__((used, section(".initcall"))) = { #id, func, dep_names }
+
+// Create the worker tasks (before scheduler_start)
+void initcall_start(void);
+
+// Record a sequential boot phase from start to now; returns now
+uint32_t bootlog_phase(const char* name, uint32_t start);
+
+// Phases, initcalls and the critical path
+void bootlog_report(void);
+
+#endif
@@ -1,16 +1,43 @@
 #include "interrupts.h"
 #include "../drivers/uart/uart.h"
+#include "../drivers/sd/sd.h"
 #include "scheduler/task.h"
+#include "smp/smp.h"
+#include "sync/spin_lock.h"
+#include "../hot.h"
+#ifdef SD_SERVICE_CORE
+#include "../drivers/sd/sd_queue.h"
+#endif
 
-volatile uint32_t timer_ticks = 0;
+volatile uint32_t timer_ticks HOT_DATA = 0;
+
+// SYSTIMER_CLO of the next tick boundary
+static uint32_t tick_next_us HOT_DATA;
+static Spinlock tick_lock = SPINLOCK_INIT;
+
+// A timer IRQ this early still counts as the tick (ARM timer vs CLO drift)
+#define TICK_SLACK_US   50
+
+static volatile uint32_t irq_counts[NUM_CORES];
+
+// Generic timer reload value for cores 1-3, and its rate per ms
+static uint32_t local_timer_interval = 0;
+static uint32_t local_timer_per_ms = 0;
 
 void interrupts_init(void) {
     uart_puts("Interrupts init\n");
+
+    // Console input and SD data: tasks sleep until the device is ready
+    // (GPU IRQs go to core 0)
+    uart_rx_irq_enable();
+    sd_irq_enable();
+    *IRQ_ENABLE_2 = IRQ_2_UART0 | IRQ_2_EMMC;
 }
 
 void timer_init(void) {
     uart_puts("ARM Timer setup...\n");
     
+    tick_next_us = *SYSTIMER_CLO + TIMER_INTERVAL;
     *ARM_TIMER_CTRL = 0;
     *ARM_TIMER_LOAD = TIMER_INTERVAL;
     *ARM_TIMER_RELOAD = TIMER_INTERVAL;
@@ -18,10 +45,128 @@ void timer_init(void) {
     *ARM_TIMER_IRQ_CLR = 0;
     *IRQ_ENABLE_BASIC = (1 << 0);
     *ARM_TIMER_CTRL = (1 << 7) | (1 << 5) | (1 << 1);
+
+    // Mailbox 0 IRQ, for IPI_RESCHED
+    *LOCAL_MBOX_CNTL(0) = 1;
     
     uart_puts("Timer started\n");
 }
 
+HOT void ticks_sync(void) {
+    spin_lock(&tick_lock);
+    uint32_t late = *SYSTIMER_CLO + TICK_SLACK_US - tick_next_us;
+    if ((int32_t)late >= 0) {
+        uint32_t n = late / TIMER_INTERVAL + 1;
+        timer_ticks += n;
+        tick_next_us += n * TIMER_INTERVAL;
+    }
+    spin_unlock(&tick_lock);
+}
+
+uint32_t tick_time_us(uint32_t tick) {
+    spin_lock(&tick_lock);
+    uint32_t us = tick_next_us + (tick - timer_ticks - 1) * TIMER_INTERVAL;
+    spin_unlock(&tick_lock);
+    return us;
+}
+
+// Core 0: one-shot to the next tick boundary, so ticks stay on CLO
+static HOT void arm_timer_rearm(uint32_t at_us) {
+    uint32_t delay = at_us - *SYSTIMER_CLO;
+    *ARM_TIMER_LOAD = (int32_t)delay > 0 ? delay : 1;
+}
+
+/*
+ * Cores 1-3 get their preemption tick from their own generic timer
+ * (virtual timer, always accessible from SVC). Only core 0 owns the
+ * ARM timer; every core's tick brings timer_ticks up to date.
+ */
+static inline void cntv_rearm(uint32_t tval) {
+#ifdef __aarch64__
+    __asm__ __volatile__("msr cntv_tval_el0, %0" :: "r"((uint64_t)tval));
+#else
+    __asm__ __volatile__("mcr p15, 0, %0, c14, c3, 0" :: "r"(tval));           // CNTV_TVAL
+#endif
+}
+
+void local_timer_init(void) {
+#ifdef __aarch64__
+    uint64_t freq;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+#else
+    uint32_t freq;
+    __asm__ __volatile__("mrc p15, 0, %0, c14, c0, 0" : "=r"(freq));   // CNTFRQ
+#endif
+
+    local_timer_interval = freq / (1000000 / TIMER_INTERVAL);
+    local_timer_per_ms = freq / 1000;
+
+    cntv_rearm(local_timer_interval);
+#ifdef __aarch64__
+    __asm__ __volatile__("msr cntv_ctl_el0, %0" :: "r"(1ul));
+#else
+    __asm__ __volatile__("mcr p15, 0, %0, c14, c3, 1" :: "r"(1));      // CNTV_CTL: enable
+#endif
+    *LOCAL_TIMER_CNTL(cpu_id()) = LOCAL_CNTV_IRQ;
+}
+
+// us to generic timer counts, in 32 bits for delays up to TIMER_IDLE_MAX_US
+static uint32_t cntv_counts(uint32_t us) {
+    return (us / 1000) * local_timer_per_ms + (us % 1000) * local_timer_per_ms / 1000;
+}
+
+void timer_idle_program(uint32_t wake_us) {
+    uint32_t delay = wake_us - *SYSTIMER_CLO;
+
+    if ((int32_t)delay <= 0) {
+        delay = 1;
+    } else if (delay > TIMER_IDLE_MAX_US) {
+        delay = TIMER_IDLE_MAX_US;
+    }
+    if (cpu_id() == 0) {
+        *ARM_TIMER_LOAD = delay;
+    } else {
+        cntv_rearm(cntv_counts(delay));
+    }
+}
+
+void timer_idle_restore(void) {
+    if (cpu_id() == 0) {
+        arm_timer_rearm(tick_next_us);
+    } else {
+        cntv_rearm(local_timer_interval);
+    }
+}
+
+uint32_t irq_count(uint32_t core) {
+    return irq_counts[core];
+}
+
+#ifdef __aarch64__
+void enable_irq(void) {
+    __asm__ __volatile__("msr daifclr, #2" ::: "memory");
+}
+
+void disable_irq(void) {
+    __asm__ __volatile__("msr daifset, #2" ::: "memory");
+}
+
+HOT uint32_t irq_save(void) {
+    uint64_t flags;
+    __asm__ __volatile__("mrs %0, daif\n\tmsr daifset, #2" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+HOT void irq_restore(uint32_t flags) {
+    __asm__ __volatile__("msr daif, %0" :: "r"((uint64_t)flags) : "memory");
+}
+
+int irqs_enabled(void) {
+    uint64_t daif;
+    __asm__ __volatile__("mrs %0, daif" : "=r"(daif));
+    return !(daif & (1 << 7));
+}
+#else
 void enable_irq(void) {
     __asm__ __volatile__("cpsie i" ::: "memory");
 }
@@ -30,9 +175,93 @@ void disable_irq(void) {
     __asm__ __volatile__("cpsid i" ::: "memory");
 }
 
-void irq_handler_c(void) {
-    // Clear interrupt
-    *ARM_TIMER_IRQ_CLR = 0;
-    
-    timer_ticks++;
+HOT uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ __volatile__("mrs %0, cpsr\n\tcpsid i" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+HOT void irq_restore(uint32_t flags) {
+    __asm__ __volatile__("msr cpsr_c, %0" :: "r"(flags) : "memory");
+}
+
+int irqs_enabled(void) {
+    uint32_t cpsr;
+    __asm__ __volatile__("mrs %0, cpsr" : "=r"(cpsr));
+    return !(cpsr & (1 << 7));
+}
+#endif
+
+HOT void irq_handler_c(void) {
+    uint32_t core = cpu_id();
+    scheduler_irq_entry(core);
+    irq_counts[core]++;
+    uint32_t source = *LOCAL_IRQ_SOURCE(core);
+
+    // Inter-core mailbox
+    if (source & LOCAL_MBOX0_IRQ) {
+        uint32_t ipi = *LOCAL_MBOX0_CLR(core);
+        *LOCAL_MBOX0_CLR(core) = ipi;
+        if (ipi & IPI_PARK) {
+            smp_park_self();
+        }
+        // IPI_RESCHED needs nothing here: preempt_schedule runs on the way out
+#ifdef SD_SERVICE_CORE
+        if (ipi & IPI_SD_COMPLETE) {
+            sd_queue_complete();
+        }
+#endif
+    }
+
+    if (core != 0) {
+        // Re-arm this core's generic timer
+        if (source & LOCAL_CNTV_IRQ) {
+            cntv_rearm(local_timer_interval);
+            ticks_sync();
+        }
+        return;
+    }
+
+    if (*IRQ_BASIC_PENDING & 1) {
+        // Clear interrupt
+        *ARM_TIMER_IRQ_CLR = 0;
+
+        ticks_sync();
+        arm_timer_rearm(tick_next_us);
+    }
+
+    uint32_t pending2 = *IRQ_PENDING_2;
+    if (pending2 & IRQ_2_UART0) {
+        uart_irq();
+    }
+    if (pending2 & IRQ_2_EMMC) {
+        sd_irq();
+    }
+}
+
+void data_abort_c(uint32_t pc, uint32_t addr, uint32_t status, uint32_t spsr) {
+    const char* owner = task_guard_owner(addr);
+
+    uart_puts("\n*** Data abort on core ");
+    uart_putdec(cpu_id());
+    uart_puts(": PC ");
+    uart_puthex(pc);
+    uart_puts(", address ");
+    uart_puthex(addr);
+    uart_puts(", DFSR ");
+    uart_puthex(status);
+    uart_puts(", SPSR ");
+    uart_puthex(spsr);
+    uart_puts("\n");
+
+    if (owner) {
+        uart_puts("*** Stack overflow in task '");
+        uart_puts(owner);
+        uart_puts("' (guard page hit)\n");
+    }
+
+    // Other cores keep running; this one stops here
+    while (1) {
+        __asm__ __volatile__("wfe");
+    }
 }
\ No newline at end of file
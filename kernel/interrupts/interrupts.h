@@ -22,6 +22,9 @@
 #define IRQ_PENDING_2       ((volatile uint32_t*)(ARM_TIMER_BASE + 0x208))
 #define IRQ_ENABLE_BASIC    ((volatile uint32_t*)(ARM_TIMER_BASE + 0x218))
 #define IRQ_ENABLE_1        ((volatile uint32_t*)(ARM_TIMER_BASE + 0x210))
+#define IRQ_ENABLE_2        ((volatile uint32_t*)(ARM_TIMER_BASE + 0x214))
+#define IRQ_2_UART0         (1 << 25)   // GPU IRQ 57, in IRQ_PENDING_2 / IRQ_ENABLE_2
+#define IRQ_2_EMMC          (1 << 30)   // GPU IRQ 62
 #define IRQ_DISABLE_BASIC   ((volatile uint32_t*)(ARM_TIMER_BASE + 0x224))
 
 // System Timer (keep for reference)
@@ -31,14 +34,49 @@
 #define SYSTIMER_C1         ((volatile uint32_t*)(SYSTIMER_BASE + 0x10))
 #define SYSTIMER_M1         (1 << 1)
 
-#define TIMER_INTERVAL      10000
+// ARM local block: per-core timer/mailbox routing and IRQ source
+#define LOCAL_TIMER_CNTL(n) ((volatile uint32_t*)(uintptr_t)(0x40000040 + 4 * (n)))
+#define LOCAL_MBOX_CNTL(n)  ((volatile uint32_t*)(uintptr_t)(0x40000050 + 4 * (n)))
+#define LOCAL_IRQ_SOURCE(n) ((volatile uint32_t*)(uintptr_t)(0x40000060 + 4 * (n)))
+#define LOCAL_MBOX0_SET(n)  ((volatile uint32_t*)(uintptr_t)(0x40000080 + 0x10 * (n)))
+#define LOCAL_MBOX0_CLR(n)  ((volatile uint32_t*)(uintptr_t)(0x400000C0 + 0x10 * (n)))
+#define LOCAL_CNTV_IRQ      (1 << 3)
+#define LOCAL_MBOX0_IRQ     (1 << 4)
+
+#define TIMER_INTERVAL      CONFIG_TIMER_INTERVAL   // us, from the build profile
 
 extern volatile uint32_t timer_ticks;
 
+// Longest a tickless idle core goes without a timer interrupt
+#define TIMER_IDLE_MAX_US   1000000
+
 void interrupts_init(void);
 void timer_init(void);
+void local_timer_init(void);
+
+/*
+ * Tick boundaries fall every TIMER_INTERVAL us of SYSTIMER_CLO, so a
+ * core that slept through some of them catches timer_ticks up in one
+ * step. Callers have IRQs masked.
+ */
+void ticks_sync(void);
+uint32_t tick_time_us(uint32_t tick);       // SYSTIMER_CLO at which tick begins
+
+// Tickless idle on the calling core: one timer interrupt at wake_us
+// (at most TIMER_IDLE_MAX_US away), then the periodic tick again
+void timer_idle_program(uint32_t wake_us);
+void timer_idle_restore(void);
+
+// IRQs taken by a core since boot
+uint32_t irq_count(uint32_t core);
 void enable_irq(void);
 void disable_irq(void);
+uint32_t irq_save(void);
+void irq_restore(uint32_t flags);
+int irqs_enabled(void);                     // On the calling core
 void irq_handler_c(void);
 
+// Called from the data abort vector on the ABT stack; does not return
+void data_abort_c(uint32_t pc, uint32_t addr, uint32_t status, uint32_t spsr);
+
 #endif
\ No newline at end of file
@@ -6,76 +6,167 @@
 #include "../drivers/sd/sd.h"
 #include "../block/block.h"
 #include "../drivers/sd/sd_block.h"
-
+#include "./mm/mmu.h"
+#include "./smp/smp.h"
+#include "./mm/page_alloc.h"
+#include "./mm/kmalloc.h"
+#include "./scheduler/fpu.h"
+#include "./boot_times.h"
+#include "./init/initcall.h"
+#include "./warmboot.h"
+#include "./chainload.h"
+
+#if CONFIG_FATFS
 #include "../kernel/fatfs/ff.h"
 #include "../kernel/fatfs/diskio.h"
+#endif
+
+BootTimes boot_times;
+
+void boot_times_report(void) {
+    const WarmHandoff* warm = warmboot_handoff();
+    if (warm) {
+        uart_puts("Boot: warm restart #");
+        uart_putdec(warm->restarts);
+        uart_puts(", kernel entered ");
+        uart_putdec(boot_times.kernel_entry - warm->reboot_at);
+        uart_puts(" us after `reboot warm`\n\n");
+        return;
+    }
+
+    uart_puts("Boot: kernel entered at ");
+    uart_putdec(boot_times.kernel_entry);
+    uart_puts(" us");
+    if (boot_times.magic == BOOT_LZ4_MAGIC) {
+        uart_puts(" (LZ4 image loaded at ");
+        uart_putdec(boot_times.stub_entry);
+        uart_puts(" us, inflated in ");
+        uart_putdec(boot_times.inflated - boot_times.stub_entry);
+        uart_puts(" us)");
+    }
+    uart_puts("\n\n");
+}
 
-/* Background task - blink LED */
+/* Periodic job - toggle the LED (pin set up by the "led" initcall) */
 void task_blink(void) {
-    gpio_set_output(23);
+    static int on;
 
-    while (1) {
+    on = !on;
+    if (on) {
         gpio_high(23);
-        for (volatile int i = 0; i < 2000000; i++);
-
+    } else {
         gpio_low(23);
-        for (volatile int i = 0; i < 2000000; i++);
     }
 }
 
-void kernel_main(void) {
-    uart_init();
+/* -------- INITCALLS (run as tasks once the scheduler is up) -------- */
 
-    uart_puts("\n\n");
-    uart_puts("================================\n");
-    uart_puts("  SriOS - Pi Zero 2W\n");
-    uart_puts("================================\n\n");
+static int init_sd(void) {
+    const WarmHandoff* warm = warmboot_handoff();
 
-    /* -------- SD CARD INIT -------- */
-    if (sd_init() != SD_OK) {
+    if (warm && sd_resume(&warm->sd) == SD_OK) {
+        log_puts("SD Card resumed from warm handoff\n");
+    } else if (sd_init() != SD_OK) {
         uart_puts("SD Card init failed!\n");
-    } else {
-        uart_puts("SD Card initialized successfully\n");
+        return -1;
     }
+    log_puts("SD Card initialized successfully\n");
 
     sd_block_init();
-
-    block_device_t *dev = block_get("sd0");
-    if (!dev) {
+    if (!block_get("sd0")) {
         uart_puts("No block device found\n");
-        while (1);
+        return -1;
     }
+    return 0;
+}
+INITCALL(sd, init_sd, "");
 
+#if CONFIG_SD_TEST
+static int init_sd_test(void) {
     test_sd_read();
+    return 0;
+}
+INITCALL(sd_test, init_sd_test, "sd");
+#endif
 
-    /* -------- FATFS MOUNT -------- */
+#if CONFIG_FATFS
+static int init_mount(void) {
     static FATFS fs;
     FRESULT res;
 
-    uart_puts("Mounting FATFS...\n");
+    log_puts("Mounting FATFS...\n");
     res = f_mount(&fs, "0:", 1);
 
-    uart_puts("f_mount returned: ");
-    uart_puthex(res);
-    uart_puts("\n");
+    log_puts("f_mount returned: ");
+    log_puthex(res);
+    log_puts("\n");
 
     if (res != FR_OK) {
         uart_puts("FATFS mount failed\n");
-        while (1);
+        return -1;
     }
 
-    uart_puts("FATFS mounted successfully\n");
+    log_puts("FATFS mounted successfully\n");
+    return 0;
+}
+INITCALL(mount, init_mount, "sd");
+#endif
+
+static int init_led(void) {
+    gpio_set_output(23);
+    // 2 Hz blink; a GPIO write fits the budget many times over
+    return task_create_periodic("Blink", task_blink, 250000, 100, 0) < 0 ? -1 : 0;
+}
+INITCALL(led, init_led, "");
+
+void kernel_main(void) {
+    uart_init();
+
+    uart_puts("\n\n");
+    uart_puts("================================\n");
+    uart_puts("  SriOS - Pi Zero 2W\n");
+    uart_puts("================================\n\n");
+
+    boot_times_report();
+    uint32_t t = bootlog_phase("boot.S", boot_times.kernel_entry);
+
+#if CONFIG_CHAINLOAD
+    /* -------- SERIAL CHAINLOAD (returns if no image arrives) -------- */
+    chainload_wait();
+    t = bootlog_phase("chainload", t);
+#endif
+
+    /* -------- MMU / CACHES (enabled in boot.S) -------- */
+    mmu_self_check();
+    t = bootlog_phase("mmu", t);
+
+    /* -------- PHYSICAL MEMORY -------- */
+    page_alloc_init();
+    kmalloc_init();
+    t = bootlog_phase("mm", t);
+
+    /* -------- VFP/NEON (lazily switched per task) -------- */
+    fpu_init();
+
+    /* -------- SMP: cores 1-3 wait for scheduler_start -------- */
+    smp_init();
+    t = bootlog_phase("smp", t);
 
     /* -------- SET VECTOR BASE -------- */
     extern char _vectors;
+#ifdef __aarch64__
+    __asm__ __volatile__("msr vbar_el1, %0\n\tisb" :: "r"(&_vectors));
+#else
     uint32_t vec_addr = (uint32_t)&_vectors;
     __asm__ __volatile__("mcr p15, 0, %0, c12, c0, 0" :: "r"(vec_addr));
+#endif
 
     /* -------- SCHEDULER -------- */
     scheduler_init();
 
-    task_create("Shell", shell_task, 1);
-    task_create("Blink", task_blink, 1);
+    task_create_on("Shell", shell_task, 1, 0);
+    // SD, FatFs and the LED come up alongside the shell (bootlog)
+    initcall_start();
 
     /* -------- INTERRUPTS -------- */
     interrupts_init();
@@ -84,9 +175,10 @@ void kernel_main(void) {
     uart_puts("Enabling IRQ...\n");
     enable_irq();
     uart_puts("IRQ enabled!\n\n");
+    bootlog_phase("sched", t);
 
     /* -------- START OS -------- */
     scheduler_start();
 
     while (1);
-}
\ No newline at end of file
+}
@@ -0,0 +1,272 @@
+/*
+ * alloc_trace.c - Allocation-site profiler and leak tracker
+ *
+ * Two open-addressed hash tables with linear probing:
+ *   live[]   pointer -> site, size, timestamp for every outstanding block
+ *   sites[]  caller PC -> call/free counts and live/total bytes
+ *
+ * Removal from live[] uses backward-shift deletion, so there are no
+ * tombstones and lookups stay short however long the system runs.
+ * PCs are printed raw; resolve them with addr2line against kernel.elf.
+ */
+
+#include "alloc_trace.h"
+
+#ifdef ALLOC_TRACE
+
+#include "../../drivers/uart/uart.h"
+#include "../../utils/string_utils.h"
+#include "../interrupts/interrupts.h"
+#include "../sync/spin_lock.h"
+
+#define LIVE_MASK   (ALLOC_TRACE_LIVE - 1)
+#define SITE_MASK   (ALLOC_TRACE_SITES - 1)
+#define LIVE_HOME(p)    ((hash32(p) >> 22) & LIVE_MASK)     // Top 10 bits
+#define SITE_HOME(pc)   ((hash32(pc) >> 24) & SITE_MASK)    // Top 8 bits
+#define TOP_MAX     16
+
+typedef struct {
+    uint32_t ptr;               // 0 = empty slot
+    uint32_t size;
+    uint32_t stamp;             // SYSTIMER_CLO at allocation
+    uint16_t site;              // Index into sites[]
+} live_entry_t;
+
+typedef struct {
+    uint32_t pc;                // 0 = empty slot
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t live;
+    uint32_t live_bytes;
+    uint32_t total_bytes;
+} site_entry_t;
+
+static live_entry_t live[ALLOC_TRACE_LIVE];
+static site_entry_t sites[ALLOC_TRACE_SITES];
+static uint32_t live_count;
+static uint32_t dropped;        // Not tracked: a table was full
+static uint32_t mark_stamp;
+static int marked;
+static Spinlock trace_lock = SPINLOCK_INIT;
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v >> 2) * 2654435761u;
+}
+
+static int site_lookup(uint32_t pc) {
+    uint32_t i = SITE_HOME(pc);
+
+    for (uint32_t n = 0; n < ALLOC_TRACE_SITES; n++, i = (i + 1) & SITE_MASK) {
+        if (sites[i].pc == pc) {
+            return i;
+        }
+        if (sites[i].pc == 0) {
+            sites[i].pc = pc;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int live_find(uint32_t ptr) {
+    uint32_t i = LIVE_HOME(ptr);
+
+    for (uint32_t n = 0; n < ALLOC_TRACE_LIVE; n++, i = (i + 1) & LIVE_MASK) {
+        if (live[i].ptr == ptr) {
+            return i;
+        }
+        if (live[i].ptr == 0) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// Pull later entries of the probe chain back into the hole at i
+static void live_remove(uint32_t i) {
+    uint32_t j = i;
+
+    while (1) {
+        j = (j + 1) & LIVE_MASK;
+        if (live[j].ptr == 0) {
+            break;
+        }
+        uint32_t home = LIVE_HOME(live[j].ptr);
+        int stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            live[i] = live[j];
+            i = j;
+        }
+    }
+    live[i].ptr = 0;
+    live_count--;
+}
+
+void alloc_trace_alloc(void* ptr, uint32_t size, void* pc) {
+    if (!ptr) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+
+    int s = site_lookup((uintptr_t)pc);
+    if (s < 0 || live_count >= ALLOC_TRACE_LIVE - 1) {
+        dropped++;
+        spin_unlock_irqrestore(&trace_lock, flags);
+        return;
+    }
+
+    sites[s].allocs++;
+    sites[s].live++;
+    sites[s].live_bytes += size;
+    sites[s].total_bytes += size;
+
+    uint32_t i = LIVE_HOME((uintptr_t)ptr);
+    while (live[i].ptr != 0) {
+        i = (i + 1) & LIVE_MASK;
+    }
+    live[i].ptr = (uintptr_t)ptr;
+    live[i].size = size;
+    live[i].stamp = *SYSTIMER_CLO;
+    live[i].site = (uint16_t)s;
+    live_count++;
+
+    spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+void alloc_trace_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+
+    int i = live_find((uintptr_t)ptr);
+    if (i >= 0) {
+        site_entry_t* s = &sites[live[i].site];
+        s->frees++;
+        s->live--;
+        s->live_bytes -= live[i].size;
+        live_remove(i);
+    }
+
+    spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+static uint32_t site_key(const site_entry_t* s, int by_bytes) {
+    return by_bytes ? s->live_bytes : s->allocs;
+}
+
+void alloc_trace_report(uint32_t top, int by_bytes) {
+    site_entry_t best[TOP_MAX];
+    uint32_t n = 0;
+    uint32_t tracked, lost;
+
+    if (top > TOP_MAX) {
+        top = TOP_MAX;
+    }
+
+    // Insertion into a short sorted array; snapshot under the lock
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    for (uint32_t i = 0; i < ALLOC_TRACE_SITES; i++) {
+        if (sites[i].pc == 0) {
+            continue;
+        }
+        uint32_t key = site_key(&sites[i], by_bytes);
+        uint32_t pos = n;
+        while (pos > 0 && site_key(&best[pos - 1], by_bytes) < key) {
+            pos--;
+        }
+        if (pos >= top) {
+            continue;
+        }
+        if (n < top) {
+            n++;
+        }
+        for (uint32_t j = n - 1; j > pos; j--) {
+            best[j] = best[j - 1];
+        }
+        best[pos] = sites[i];
+    }
+    tracked = live_count;
+    lost = dropped;
+    spin_unlock_irqrestore(&trace_lock, flags);
+
+    uart_puts("\n  Top sites by ");
+    uart_puts(by_bytes ? "live bytes" : "allocation count");
+    uart_puts("\n  Caller PC     Allocs     Frees   Live    Live bytes   Total bytes\n");
+    for (uint32_t i = 0; i < n; i++) {
+        uart_puts("  ");
+        uart_puthex(best[i].pc);
+        uart_puts("  ");
+        uart_putdec(best[i].allocs);
+        uart_puts("  ");
+        uart_putdec(best[i].frees);
+        uart_puts("  ");
+        uart_putdec(best[i].live);
+        uart_puts("  ");
+        uart_putdec(best[i].live_bytes);
+        uart_puts("  ");
+        uart_putdec(best[i].total_bytes);
+        uart_puts("\n");
+    }
+    uart_puts("  Live allocations tracked: ");
+    uart_putdec(tracked);
+    uart_puts(", dropped: ");
+    uart_putdec(lost);
+    uart_puts("\n\n");
+}
+
+void alloc_trace_live(void) {
+    uint32_t now = *SYSTIMER_CLO;
+    uint32_t shown = 0;
+
+    uart_puts("\n  Address     Size   Age ms  Caller PC\n");
+
+    // One entry per lock hold: UART output must not run with IRQs off.
+    // Entries freed meanwhile may shift, so the list is best effort.
+    for (uint32_t i = 0; i < ALLOC_TRACE_LIVE; i++) {
+        uint32_t flags = spin_lock_irqsave(&trace_lock);
+        live_entry_t e = live[i];
+        uint32_t pc = sites[e.site].pc;
+        int newer = !marked || (int32_t)(e.stamp - mark_stamp) >= 0;
+        spin_unlock_irqrestore(&trace_lock, flags);
+
+        if (e.ptr == 0 || !newer) {
+            continue;
+        }
+        uart_puts("  ");
+        uart_puthex(e.ptr);
+        uart_puts("  ");
+        uart_putdec(e.size);
+        uart_puts("  ");
+        uart_putdec((now - e.stamp) / 1000);
+        uart_puts("  ");
+        uart_puthex(pc);
+        uart_puts("\n");
+        shown++;
+    }
+
+    uart_puts("  ");
+    uart_putdec(shown);
+    uart_puts(marked ? " live since mark\n\n" : " live\n\n");
+}
+
+void alloc_trace_mark(void) {
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    mark_stamp = *SYSTIMER_CLO;
+    marked = 1;
+    spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+void alloc_trace_reset(void) {
+    uint32_t flags = spin_lock_irqsave(&trace_lock);
+    memset(live, 0, sizeof(live));
+    memset(sites, 0, sizeof(sites));
+    live_count = 0;
+    dropped = 0;
+    marked = 0;
+    spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ALLOC_TRACE_H
+#define ALLOC_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Allocation-site profiler for kmalloc and the slab caches.
+ * Built only with `make ALLOC_TRACE=1`; otherwise every hook compiles
+ * away and no tables are linked in.
+ */
+
+#ifdef ALLOC_TRACE
+
+#define ALLOC_TRACE_LIVE    1024    // Outstanding allocations tracked
+#define ALLOC_TRACE_SITES   256     // Distinct caller PCs
+
+// Hooks called by the allocators
+void alloc_trace_alloc(void* ptr, uint32_t size, void* pc);
+void alloc_trace_free(void* ptr);
+
+// Top sites by live bytes (by_bytes) or by allocation count
+void alloc_trace_report(uint32_t top, int by_bytes);
+
+// Live allocations made after the last mark (all if never marked)
+void alloc_trace_live(void);
+void alloc_trace_mark(void);
+
+// Forget all sites and live entries
+void alloc_trace_reset(void);
+
+#else
+
+#define alloc_trace_alloc(ptr, size, pc)    ((void)0)
+#define alloc_trace_free(ptr)               ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,523 @@
+/*
+ * kmalloc.c - TLSF (two-level segregated fit) kernel heap
+ *
+ * Free blocks are binned by size into FL_COUNT power-of-two classes, each
+ * split into SL_COUNT linear sub-classes. Two bitmaps record which bins are
+ * non-empty, so finding a fitting block is two find-first-set operations
+ * and allocate/free run in constant time regardless of heap state.
+ *
+ * Every block starts with a header (previous physical block and
+ * payload size); free blocks also keep their bin links in the payload.
+ * Neighbouring free blocks are merged immediately on free.
+ *
+ * The heap is backed by page blocks from the buddy allocator: one at boot,
+ * more on demand, and extra pools are returned once they are fully free.
+ */
+
+#include "kmalloc.h"
+#include "page_alloc.h"
+#include "alloc_trace.h"
+#include "../../drivers/uart/uart.h"
+#include "../../utils/string_utils.h"
+#include "../sync/spin_lock.h"
+
+#define SL_LOG2         4
+#define SL_COUNT        (1 << SL_LOG2)
+#define FL_SHIFT        (SL_LOG2 + 3)           // log2(SL_COUNT * KMALLOC_ALIGN)
+#define SMALL_SIZE      (1u << FL_SHIFT)        // Below this: one linear class
+#define FL_MAX_LOG2     23
+#define FL_COUNT        (FL_MAX_LOG2 - FL_SHIFT + 1)
+
+#define BLOCK_HDR       offsetof(block_t, next_free)    // 8 bytes, 16 on AArch64
+#define BLOCK_MIN       (2 * sizeof(block_t*))          // Room for the free-list links
+#define BLOCK_FREE      1u
+#define BLOCK_FLAGS     (KMALLOC_ALIGN - 1)
+
+#define KMALLOC_INIT_ORDER  8                   // 1 MB at boot
+#define KMALLOC_GROW_ORDER  6                   // At least 256 KB per extra pool
+
+typedef struct block {
+    struct block* prev_phys;    // 0 for the first block of a pool
+    uint32_t size;              // Payload bytes | BLOCK_FREE
+    struct block* next_free;    // Only valid while free
+    struct block* prev_free;
+} block_t;
+
+typedef struct {
+    uintptr_t base;
+    uint32_t bytes;
+} pool_t;
+
+static block_t* bins[FL_COUNT][SL_COUNT];
+static uint32_t fl_bitmap;
+static uint32_t sl_bitmap[FL_COUNT];
+
+static pool_t pools[KMALLOC_MAX_POOLS];
+static uint32_t pool_count;
+
+static uint32_t used_bytes;
+static uint32_t peak_bytes;
+static uint32_t alloc_count;
+static uint32_t free_count;
+static uint32_t fail_count;
+
+static Spinlock heap_lock = SPINLOCK_INIT;
+
+// ============== BLOCK HELPERS ==============
+static inline uint32_t block_size(const block_t* b) {
+    return b->size & ~BLOCK_FLAGS;
+}
+
+static inline int block_is_free(const block_t* b) {
+    return b->size & BLOCK_FREE;
+}
+
+static inline block_t* block_next(const block_t* b) {
+    return (block_t*)((uint8_t*)b + BLOCK_HDR + block_size(b));
+}
+
+static inline void* block_payload(block_t* b) {
+    return (uint8_t*)b + BLOCK_HDR;
+}
+
+static inline uint32_t fls32(uint32_t x) {
+    return 31 - __builtin_clz(x);
+}
+
+// ============== BINS ==============
+static void mapping_insert(uint32_t size, uint32_t* fl, uint32_t* sl) {
+    if (size < SMALL_SIZE) {
+        *fl = 0;
+        *sl = size / KMALLOC_ALIGN;
+    } else {
+        uint32_t msb = fls32(size);
+        *sl = (size >> (msb - SL_LOG2)) ^ SL_COUNT;
+        *fl = msb - FL_SHIFT + 1;
+    }
+}
+
+// Round up so that any block in the resulting bin is large enough
+static void mapping_search(uint32_t size, uint32_t* fl, uint32_t* sl) {
+    if (size >= SMALL_SIZE) {
+        size += (1u << (fls32(size) - SL_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static block_t* find_suitable(uint32_t* fl, uint32_t* sl) {
+    uint32_t sl_map = sl_bitmap[*fl] & (~0u << *sl);
+
+    if (!sl_map) {
+        uint32_t fl_map = fl_bitmap & (~0u << (*fl + 1));
+        if (!fl_map) {
+            return 0;
+        }
+        *fl = __builtin_ctz(fl_map);
+        sl_map = sl_bitmap[*fl];
+    }
+    *sl = __builtin_ctz(sl_map);
+    return bins[*fl][*sl];
+}
+
+static void insert_free(block_t* b) {
+    uint32_t fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+
+    b->size |= BLOCK_FREE;
+    b->prev_free = 0;
+    b->next_free = bins[fl][sl];
+    if (b->next_free) {
+        b->next_free->prev_free = b;
+    }
+    bins[fl][sl] = b;
+
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+}
+
+static void remove_free(block_t* b) {
+    uint32_t fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+
+    if (b->prev_free) {
+        b->prev_free->next_free = b->next_free;
+    } else {
+        bins[fl][sl] = b->next_free;
+    }
+    if (b->next_free) {
+        b->next_free->prev_free = b->prev_free;
+    }
+
+    if (!bins[fl][sl]) {
+        sl_bitmap[fl] &= ~(1u << sl);
+        if (!sl_bitmap[fl]) {
+            fl_bitmap &= ~(1u << fl);
+        }
+    }
+    b->size &= ~BLOCK_FREE;
+}
+
+// Trim a used block to size bytes, freeing the tail if it is big enough
+static void block_trim(block_t* b, uint32_t size) {
+    uint32_t cur = block_size(b);
+    if (cur < size + BLOCK_HDR + BLOCK_MIN) {
+        return;
+    }
+
+    block_t* rest = (block_t*)((uint8_t*)b + BLOCK_HDR + size);
+    rest->prev_phys = b;
+    rest->size = cur - size - BLOCK_HDR;
+    b->size = size;
+
+    // The tail may border a free block (krealloc shrink)
+    block_t* next = block_next(rest);
+    if (block_is_free(next)) {
+        remove_free(next);
+        rest->size += BLOCK_HDR + block_size(next);
+        next = block_next(rest);
+    }
+    next->prev_phys = rest;
+    insert_free(rest);
+}
+
+// ============== POOLS ==============
+static pool_t* pool_of(uintptr_t addr) {
+    for (uint32_t i = 0; i < pool_count; i++) {
+        if (addr - pools[i].base < pools[i].bytes) {
+            return &pools[i];
+        }
+    }
+    return 0;
+}
+
+static int pool_add(uint32_t order) {
+    if (pool_count >= KMALLOC_MAX_POOLS) {
+        return -1;
+    }
+
+    uint8_t* mem = page_alloc(order);
+    if (!mem) {
+        return -1;
+    }
+
+    uint32_t bytes = (uint32_t)PAGE_SIZE << order;
+    pools[pool_count].base = (uintptr_t)mem;
+    pools[pool_count].bytes = bytes;
+    pool_count++;
+
+    // One free block spanning the pool, then a zero-size used sentinel
+    block_t* b = (block_t*)mem;
+    b->prev_phys = 0;
+    b->size = bytes - 2 * BLOCK_HDR;
+
+    block_t* end = block_next(b);
+    end->prev_phys = b;
+    end->size = 0;
+
+    insert_free(b);
+    return 0;
+}
+
+// Give an extra pool back once its only block is free
+static void pool_release(block_t* b) {
+    if (b->prev_phys || block_next(b)->size != 0) {
+        return;
+    }
+
+    pool_t* p = pool_of((uintptr_t)b);
+    if (!p || p == &pools[0]) {
+        return;
+    }
+
+    remove_free(b);
+    page_free((void*)p->base);
+    *p = pools[--pool_count];
+}
+
+// Map a user pointer back to its block; 0 if it cannot be ours
+static block_t* ptr_to_block(void* ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+
+    if ((addr & (KMALLOC_ALIGN - 1)) || !pool_of(addr - BLOCK_HDR)) {
+        return 0;
+    }
+    return (block_t*)(addr - BLOCK_HDR);
+}
+
+static void bad_pointer(const char* what, void* ptr) {
+    uart_puts("HEAP: ");
+    uart_puts(what);
+    uart_puts(" ");
+    uart_puthex((uintptr_t)ptr);
+    uart_puts("\n");
+}
+
+// ============== API ==============
+void kmalloc_init(void) {
+    spin_init(&heap_lock);
+
+    if (pool_add(KMALLOC_INIT_ORDER) != 0) {
+        uart_puts("HEAP: no memory for initial pool\n");
+        return;
+    }
+
+    uart_puts("HEAP: ");
+    uart_putdec(pools[0].bytes >> 10);
+    uart_puts(" KB at ");
+    uart_puthex(pools[0].base);
+    uart_puts("\n");
+}
+
+static void* heap_alloc(size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+
+    if (size > KMALLOC_MAX_SIZE) {
+        fail_count++;
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return 0;
+    }
+
+    uint32_t adjust = (size + KMALLOC_ALIGN - 1) & ~(KMALLOC_ALIGN - 1);
+    uint32_t fl, sl;
+    mapping_search(adjust, &fl, &sl);
+    block_t* b = find_suitable(&fl, &sl);
+
+    if (!b) {
+        // Grow by a page block big enough to satisfy the rounded search
+        uint32_t order = page_order_for(adjust + adjust / SL_COUNT + 2 * BLOCK_HDR);
+        if (order < KMALLOC_GROW_ORDER) {
+            order = KMALLOC_GROW_ORDER;
+        }
+        if (pool_add(order) == 0) {
+            mapping_search(adjust, &fl, &sl);
+            b = find_suitable(&fl, &sl);
+        }
+    }
+
+    if (!b) {
+        fail_count++;
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return 0;
+    }
+
+    remove_free(b);
+    block_trim(b, adjust);
+
+    used_bytes += BLOCK_HDR + block_size(b);
+    if (used_bytes > peak_bytes) {
+        peak_bytes = used_bytes;
+    }
+    alloc_count++;
+
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return block_payload(b);
+}
+
+static void heap_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+
+    block_t* b = ptr_to_block(ptr);
+    if (!b || block_is_free(b)) {
+        spin_unlock_irqrestore(&heap_lock, flags);
+        bad_pointer(b ? "double kfree" : "kfree of bad pointer", ptr);
+        return;
+    }
+
+    used_bytes -= BLOCK_HDR + block_size(b);
+    free_count++;
+
+    block_t* prev = b->prev_phys;
+    if (prev && block_is_free(prev)) {
+        remove_free(prev);
+        prev->size += BLOCK_HDR + block_size(b);
+        b = prev;
+    }
+
+    block_t* next = block_next(b);
+    if (block_is_free(next)) {
+        remove_free(next);
+        b->size += BLOCK_HDR + block_size(next);
+        next = block_next(b);
+    }
+    next->prev_phys = b;
+
+    insert_free(b);
+    pool_release(b);
+
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
+
+void* kmalloc(size_t size) {
+    void* ptr = heap_alloc(size);
+    alloc_trace_alloc(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    // Untrack first: once freed the address can be handed out again
+    alloc_trace_free(ptr);
+    heap_free(ptr);
+}
+
+void* krealloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return kmalloc(size);
+    }
+    if (size == 0) {
+        kfree(ptr);
+        return 0;
+    }
+
+    if (size > KMALLOC_MAX_SIZE) {
+        return 0;
+    }
+
+    uint32_t adjust = (size + KMALLOC_ALIGN - 1) & ~(KMALLOC_ALIGN - 1);
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+
+    block_t* b = ptr_to_block(ptr);
+    if (!b || block_is_free(b)) {
+        spin_unlock_irqrestore(&heap_lock, flags);
+        bad_pointer("krealloc of bad pointer", ptr);
+        return 0;
+    }
+
+    uint32_t cur = block_size(b);
+    block_t* next = block_next(b);
+
+    // Shrink in place, or grow into a free neighbour
+    if (adjust > cur && block_is_free(next) &&
+        cur + BLOCK_HDR + block_size(next) >= adjust) {
+        remove_free(next);
+        b->size += BLOCK_HDR + block_size(next);
+        block_next(b)->prev_phys = b;
+    }
+
+    if (adjust <= block_size(b)) {
+        block_trim(b, adjust);
+        used_bytes += block_size(b) - cur;
+        if (used_bytes > peak_bytes) {
+            peak_bytes = used_bytes;
+        }
+        spin_unlock_irqrestore(&heap_lock, flags);
+
+        // The realloc site becomes the owner
+        alloc_trace_free(ptr);
+        alloc_trace_alloc(ptr, size, __builtin_return_address(0));
+        return ptr;
+    }
+
+    spin_unlock_irqrestore(&heap_lock, flags);
+
+    // Move; the original block stays valid on failure
+    void* moved = heap_alloc(size);
+    if (!moved) {
+        return 0;
+    }
+    memcpy(moved, ptr, cur);
+    alloc_trace_free(ptr);
+    heap_free(ptr);
+    alloc_trace_alloc(moved, size, __builtin_return_address(0));
+    return moved;
+}
+
+void kmalloc_get_stats(kmalloc_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+
+    stats->pools = pool_count;
+    for (uint32_t i = 0; i < pool_count; i++) {
+        stats->heap_bytes += pools[i].bytes;
+
+        block_t* b = (block_t*)pools[i].base;
+        while (b->size != 0) {
+            if (block_is_free(b)) {
+                uint32_t sz = block_size(b);
+                stats->free_bytes += sz;
+                stats->free_blocks++;
+                if (sz > stats->largest_free) {
+                    stats->largest_free = sz;
+                }
+            }
+            b = block_next(b);
+        }
+    }
+
+    stats->used_bytes = used_bytes;
+    stats->peak_bytes = peak_bytes;
+    stats->allocs = alloc_count;
+    stats->frees = free_count;
+    stats->failures = fail_count;
+
+    spin_unlock_irqrestore(&heap_lock, flags);
+
+    // At most 8 x 4 MB of heap, so largest_free * 100 fits in 32 bits
+    if (stats->free_bytes) {
+        stats->frag_pct = 100 - (stats->largest_free * 100) / stats->free_bytes;
+    }
+}
+
+int kmalloc_check(void) {
+    int err = 0;
+    uint32_t phys_free = 0;
+    uint32_t binned = 0;
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+
+    for (uint32_t i = 0; i < pool_count && !err; i++) {
+        uintptr_t end = pools[i].base + pools[i].bytes;
+        block_t* prev = 0;
+        block_t* b = (block_t*)pools[i].base;
+
+        while (!err) {
+            if (b->prev_phys != prev || (uintptr_t)b + BLOCK_HDR > end) {
+                err = -1;
+                break;
+            }
+            if (b->size == 0) {
+                // Sentinel must sit exactly at the end of the pool
+                if ((uintptr_t)b + BLOCK_HDR != end) {
+                    err = -1;
+                }
+                break;
+            }
+            if (block_is_free(b)) {
+                uint32_t fl, sl;
+                mapping_insert(block_size(b), &fl, &sl);
+                if ((prev && block_is_free(prev)) || !(sl_bitmap[fl] & (1u << sl))) {
+                    err = -1;
+                }
+                phys_free++;
+            }
+            prev = b;
+            b = block_next(b);
+        }
+    }
+
+    for (uint32_t fl = 0; fl < FL_COUNT; fl++) {
+        for (uint32_t sl = 0; sl < SL_COUNT; sl++) {
+            for (block_t* b = bins[fl][sl]; b; b = b->next_free) {
+                binned++;
+            }
+        }
+    }
+    if (binned != phys_free) {
+        err = -1;
+    }
+
+    spin_unlock_irqrestore(&heap_lock, flags);
+
+    if (err) {
+        uart_puts("HEAP: consistency check FAILED\n");
+    }
+    return err;
+}
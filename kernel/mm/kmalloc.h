@@ -0,0 +1,40 @@
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define KMALLOC_ALIGN       8
+#define KMALLOC_MAX_SIZE    (1u << 22)      // Largest single request (4 MB - overhead)
+#define KMALLOC_MAX_POOLS   8
+
+typedef struct {
+    uint32_t pools;             // Page blocks backing the heap
+    uint32_t heap_bytes;        // Total bytes in all pools
+    uint32_t used_bytes;        // Allocated payload + headers
+    uint32_t peak_bytes;        // High-water mark of used_bytes
+    uint32_t free_bytes;        // Sum of free payloads
+    uint32_t free_blocks;
+    uint32_t largest_free;
+    uint32_t frag_pct;          // 100 - largest_free * 100 / free_bytes
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+} kmalloc_stats_t;
+
+// Take the first pool from the page allocator. Call after page_alloc_init().
+void kmalloc_init(void);
+
+// O(1) apart from growing the heap by one page block. Safe from any task
+// and with IRQs masked. Returns 0 on failure.
+void* kmalloc(size_t size);
+void kfree(void* ptr);
+void* krealloc(void* ptr, size_t size);
+
+// Walk every pool and collect statistics
+void kmalloc_get_stats(kmalloc_stats_t* stats);
+
+// Walk every pool checking headers and links; returns 0 if consistent
+int kmalloc_check(void);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * mmu.c - Identity-mapped MMU setup and cache control
+ *
+ * One level-1 table of 4096 x 1 MB sections:
+ *   0x00000000 - 0x3EFFFFFF  normal RAM, write-back cacheable
+ *   0x3F000000 - 0x400FFFFF  peripherals + ARM local block, device
+ *   everything else          fault
+ *
+ * STACK_GUARD builds split the page pool's sections into level-2 tables
+ * of 4 KB pages with the same attributes before the other cores start,
+ * so a guard page never has to replace a live section mapping.
+ */
+
+#include "mmu.h"
+#include "page_alloc.h"
+#include "../../drivers/uart/uart.h"
+#include "../sync/spin_lock.h"
+
+// Level-1 translation table (must be 16 KB aligned)
+static uint32_t l1_table[4096] __attribute__((aligned(16384)));
+
+// Level-2 tables are carved four to a page as sections get split
+static uint32_t* l2_spare;
+static uint32_t l2_spare_count;
+static Spinlock mmu_lock = SPINLOCK_INIT;
+
+#ifdef STACK_GUARD
+extern char __heap_start;
+
+// The pool's first section also holds the kernel and the boot stacks,
+// which cannot be unmapped for a split, so mmu_init splits it
+static uint32_t l2_heap_start[MMU_L2_SIZE / 4] __attribute__((aligned(MMU_L2_SIZE)));
+#endif
+
+// Implemented in cache.S
+extern void dcache_invalidate_all(void);
+
+static inline uint32_t sctlr_read(void) {
+    uint32_t val;
+    __asm__ __volatile__("mrc p15, 0, %0, c1, c0, 0" : "=r"(val));
+    return val;
+}
+
+static inline void sctlr_write(uint32_t val) {
+    __asm__ __volatile__("mcr p15, 0, %0, c1, c0, 0" :: "r"(val) : "memory");
+    __asm__ __volatile__("isb" ::: "memory");
+}
+
+static uint32_t dcache_line_size(void) {
+    uint32_t ctr;
+    __asm__ __volatile__("mrc p15, 0, %0, c0, c0, 1" : "=r"(ctr));
+    return 4 << ((ctr >> 16) & 0xF);
+}
+
+// Caches only stay coherent between cores once the SMP bit is set
+static void cpu_enable_coherency(void) {
+    uint32_t midr;
+    __asm__ __volatile__("mrc p15, 0, %0, c0, c0, 0" : "=r"(midr));
+    uint32_t part = (midr >> 4) & 0xFFF;
+
+    if (part == 0xD03) {
+        // Cortex-A53: CPUECTLR.SMPEN (64-bit register)
+        uint32_t lo, hi;
+        __asm__ __volatile__("mrrc p15, 1, %0, %1, c15" : "=r"(lo), "=r"(hi));
+        lo |= (1 << 6);
+        __asm__ __volatile__("mcrr p15, 1, %0, %1, c15" :: "r"(lo), "r"(hi));
+    } else if (part == 0xC07) {
+        // Cortex-A7 (QEMU raspi2b): ACTLR.SMP
+        uint32_t actlr;
+        __asm__ __volatile__("mrc p15, 0, %0, c1, c0, 1" : "=r"(actlr));
+        actlr |= (1 << 6);
+        __asm__ __volatile__("mcr p15, 0, %0, c1, c0, 1" :: "r"(actlr));
+    }
+    __asm__ __volatile__("isb" ::: "memory");
+}
+
+// Per-core part: coherency, clean caches/TLB, load TTBR0, enable
+static void mmu_enable(void) {
+    cpu_enable_coherency();
+
+    // Start from clean state: caches, TLB and branch predictor
+    dcache_invalidate_all();
+    __asm__ __volatile__("mcr p15, 0, %0, c7, c5, 0" :: "r"(0));   // ICIALLU
+    __asm__ __volatile__("mcr p15, 0, %0, c7, c5, 6" :: "r"(0));   // BPIALL
+    __asm__ __volatile__("mcr p15, 0, %0, c8, c7, 0" :: "r"(0));   // TLBIALL
+    __asm__ __volatile__("dsb" ::: "memory");
+
+    // Domain 0 = client (permissions checked)
+    __asm__ __volatile__("mcr p15, 0, %0, c3, c0, 0" :: "r"(1));
+    // TTBCR = 0: TTBR0 covers the whole 4 GB
+    __asm__ __volatile__("mcr p15, 0, %0, c2, c0, 2" :: "r"(0));
+    // TTBR0: table walks inner/outer WB-WA, shareable
+    uint32_t ttbr0 = (uint32_t)l1_table | (1 << 6) | (1 << 3) | (1 << 1);
+    __asm__ __volatile__("mcr p15, 0, %0, c2, c0, 0" :: "r"(ttbr0));
+    __asm__ __volatile__("isb" ::: "memory");
+
+    sctlr_write(sctlr_read() | SCTLR_M | SCTLR_C | SCTLR_I | SCTLR_Z);
+}
+
+// Same mapping as section idx, page by page
+static void l2_fill(uint32_t* l2, uint32_t idx) {
+    uint32_t base = idx * MMU_SECTION_SIZE;
+
+    for (uint32_t i = 0; i < MMU_L2_SIZE / 4; i++) {
+        l2[i] = (base + (i << 12)) | MMU_PAGE_NORMAL_WBWA;
+    }
+}
+
+void mmu_init(void) {
+    for (uint32_t i = 0; i < 4096; i++) {
+        uint32_t base = i * MMU_SECTION_SIZE;
+
+        if (base < MMU_RAM_END) {
+            l1_table[i] = base | MMU_NORMAL_WBWA;
+        } else if (base < MMU_DEVICE_END) {
+            l1_table[i] = base | MMU_DEVICE;
+        } else {
+            l1_table[i] = 0;
+        }
+    }
+
+#ifdef STACK_GUARD
+    // MMU still off: there is no live mapping to break
+    uint32_t idx = (uint32_t)&__heap_start >> 20;
+    l2_fill(l2_heap_start, idx);
+    l1_table[idx] = (uint32_t)l2_heap_start | MMU_COARSE;
+#endif
+
+    mmu_enable();
+}
+
+void mmu_enable_secondary(void) {
+    mmu_enable();
+}
+
+// Translate a VA with ATS1CPR and return PAR (bit 0 = fault)
+static uint32_t mmu_translate(uint32_t va) {
+    uint32_t par;
+    __asm__ __volatile__("mcr p15, 0, %0, c7, c8, 0" :: "r"(va));
+    __asm__ __volatile__("isb" ::: "memory");
+    __asm__ __volatile__("mrc p15, 0, %0, c7, c4, 0" : "=r"(par));
+    return par;
+}
+
+static int mmu_check_va(const char* what, uint32_t va, uint32_t inner_attr) {
+    uint32_t par = mmu_translate(va);
+    int ok = !(par & 1) &&
+             (par & 0xFFF00000) == (va & 0xFFF00000) &&
+             ((par >> 4) & 7) == inner_attr;
+
+    uart_puts("  ");
+    uart_puts(what);
+    uart_puts(" ");
+    uart_puthex(va);
+    uart_puts(" -> PAR ");
+    uart_puthex(par);
+    uart_puts(ok ? "  OK\n" : "  FAIL\n");
+    return ok ? 0 : -1;
+}
+
+int mmu_self_check(void) {
+    extern char __start;
+    int err = 0;
+    uint32_t sctlr = sctlr_read();
+
+    uart_puts("MMU self-check:\n");
+    uart_puts("  SCTLR = ");
+    uart_puthex(sctlr);
+    uart_puts((sctlr & SCTLR_M) ? "  MMU on" : "  MMU OFF");
+    uart_puts((sctlr & SCTLR_C) ? ", D-cache on" : ", D-cache OFF");
+    uart_puts((sctlr & SCTLR_I) ? ", I-cache on\n" : ", I-cache OFF\n");
+    if ((sctlr & (SCTLR_M | SCTLR_C | SCTLR_I)) != (SCTLR_M | SCTLR_C | SCTLR_I)) {
+        err = -1;
+    }
+
+    // PAR inner attributes: 0b101 = WB-WA, 0b011 = device
+    err |= mmu_check_va("kernel", (uint32_t)&__start, 5);
+    uint32_t sp;
+    __asm__ __volatile__("mov %0, sp" : "=r"(sp));
+    err |= mmu_check_va("stack ", sp, 5);
+    err |= mmu_check_va("periph", 0x3F201000, 3);
+
+    // Cached write must be visible through a clean + invalidate
+    static volatile uint32_t probe[16] __attribute__((aligned(64)));
+    probe[0] = 0xC0FFEE01;
+    dcache_clean_range((const void*)probe, sizeof(probe));
+    dcache_invalidate_range((const void*)probe, sizeof(probe));
+    if (probe[0] != 0xC0FFEE01) {
+        uart_puts("  cache maintenance  FAIL\n");
+        err = -1;
+    }
+
+    uart_puts(err ? "MMU self-check FAILED\n" : "MMU self-check passed\n");
+    return err;
+}
+
+void dcache_clean_range(const void* start, uint32_t len) {
+    uint32_t line = dcache_line_size();
+    uint32_t addr = (uint32_t)start & ~(line - 1);
+    uint32_t end = (uint32_t)start + len;
+
+    for (; addr < end; addr += line) {
+        __asm__ __volatile__("mcr p15, 0, %0, c7, c10, 1" :: "r"(addr));  // DCCMVAC
+    }
+    __asm__ __volatile__("dsb" ::: "memory");
+}
+
+void dcache_invalidate_range(const void* start, uint32_t len) {
+    uint32_t line = dcache_line_size();
+    uint32_t addr = (uint32_t)start & ~(line - 1);
+    uint32_t end = (uint32_t)start + len;
+
+    for (; addr < end; addr += line) {
+        __asm__ __volatile__("mcr p15, 0, %0, c7, c6, 1" :: "r"(addr));   // DCIMVAC
+    }
+    __asm__ __volatile__("dsb" ::: "memory");
+}
+
+// Invalidate one VA in every core's TLB (inner shareable)
+static void tlb_invalidate_va(uint32_t va) {
+    __asm__ __volatile__("dsb" ::: "memory");
+    __asm__ __volatile__("mcr p15, 0, %0, c8, c3, 1" :: "r"(va & ~0xFFF));   // TLBIMVAIS
+    __asm__ __volatile__("mcr p15, 0, %0, c7, c1, 6" :: "r"(0));             // BPIALLIS
+    __asm__ __volatile__("dsb\n\tisb" ::: "memory");
+}
+
+int mmu_split_range(uint32_t start, uint32_t end) {
+    uint32_t flags = spin_lock_irqsave(&mmu_lock);
+
+    for (uint32_t idx = start >> 20; idx < (end + MMU_SECTION_SIZE - 1) >> 20; idx++) {
+        if ((l1_table[idx] & 3) == MMU_COARSE) {
+            continue;
+        }
+        if (l2_spare_count == 0) {
+            l2_spare = page_alloc(0);
+            if (!l2_spare) {
+                spin_unlock_irqrestore(&mmu_lock, flags);
+                uart_puts("MMU: out of memory splitting sections\n");
+                return -1;
+            }
+            l2_spare_count = PAGE_SIZE / MMU_L2_SIZE;
+        }
+        uint32_t* l2 = l2_spare;
+        l2_spare += MMU_L2_SIZE / 4;
+        l2_spare_count--;
+
+        l2_fill(l2, idx);
+        dcache_clean_range(l2, MMU_L2_SIZE);
+
+        // Break-before-make: the A53 may not hold the section and its
+        // pages in the TLB at once
+        l1_table[idx] = 0;
+        dcache_clean_range(&l1_table[idx], 4);
+        tlb_invalidate_va(idx * MMU_SECTION_SIZE);
+        l1_table[idx] = (uint32_t)l2 | MMU_COARSE;
+        dcache_clean_range(&l1_table[idx], 4);
+        __asm__ __volatile__("isb" ::: "memory");
+    }
+
+    spin_unlock_irqrestore(&mmu_lock, flags);
+    return 0;
+}
+
+// Caller holds mmu_lock. The level-2 table covering va, or 0 if its
+// section was never split.
+static uint32_t* l2_table_for(uint32_t va) {
+    uint32_t desc = l1_table[va >> 20];
+
+    if ((desc & 3) != MMU_COARSE) {
+        return 0;
+    }
+    return (uint32_t*)(desc & ~(MMU_L2_SIZE - 1));
+}
+
+static int mmu_set_page(void* page, int mapped) {
+    uint32_t va = (uint32_t)page;
+
+    if ((va & (PAGE_SIZE - 1)) || va >= MMU_RAM_END) {
+        return -1;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&mmu_lock);
+
+    uint32_t* l2 = l2_table_for(va);
+    if (!l2) {
+        spin_unlock_irqrestore(&mmu_lock, flags);
+        return -1;
+    }
+
+    uint32_t* pte = &l2[(va >> 12) & 0xFF];
+    *pte = mapped ? (va | MMU_PAGE_NORMAL_WBWA) : 0;
+    dcache_clean_range(pte, 4);
+    tlb_invalidate_va(va);
+
+    spin_unlock_irqrestore(&mmu_lock, flags);
+    return 0;
+}
+
+int mmu_guard_page(void* page) {
+    // Nothing cached may be written back into the page once it faults
+    dcache_clean_range(page, PAGE_SIZE);
+    dcache_invalidate_range(page, PAGE_SIZE);
+    return mmu_set_page(page, 0);
+}
+
+int mmu_unguard_page(void* page) {
+    return mmu_set_page(page, 1);
+}
+
+void cache_enable(void) {
+    __asm__ __volatile__("mcr p15, 0, %0, c7, c5, 0" :: "r"(0));   // ICIALLU
+    __asm__ __volatile__("mcr p15, 0, %0, c7, c5, 6" :: "r"(0));   // BPIALL
+    __asm__ __volatile__("dsb" ::: "memory");
+    sctlr_write(sctlr_read() | SCTLR_C | SCTLR_I);
+}
+
+int cache_enabled(void) {
+    return (sctlr_read() & SCTLR_C) != 0;
+}
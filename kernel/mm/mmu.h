@@ -0,0 +1,75 @@
+#ifndef MMU_H
+#define MMU_H
+
+#include <stdint.h>
+
+// Short-descriptor 1 MB section attributes
+#define MMU_SECTION         (2 << 0)
+#define MMU_B               (1 << 2)
+#define MMU_C               (1 << 3)
+#define MMU_XN              (1 << 4)
+#define MMU_AP_RW           (3 << 10)
+#define MMU_TEX(x)          ((x) << 12)
+#define MMU_S               (1 << 16)
+
+// Normal memory, inner/outer write-back write-allocate, shareable
+#define MMU_NORMAL_WBWA     (MMU_SECTION | MMU_TEX(1) | MMU_C | MMU_B | MMU_AP_RW | MMU_S)
+// Shareable device memory, never executable
+#define MMU_DEVICE          (MMU_SECTION | MMU_B | MMU_XN | MMU_AP_RW)
+
+// Level-2 (coarse table) descriptors for 4 KB pages
+#define MMU_COARSE          (1 << 0)
+#define MMU_L2_SIZE         1024        // 256 entries, 1 KB aligned
+#define MMU_PAGE_SMALL      (1 << 1)
+#define MMU_PAGE_AP_RW      (3 << 4)
+#define MMU_PAGE_TEX(x)     ((x) << 6)
+#define MMU_PAGE_S          (1 << 10)
+#define MMU_PAGE_NORMAL_WBWA (MMU_PAGE_SMALL | MMU_PAGE_TEX(1) | MMU_C | MMU_B | \
+                              MMU_PAGE_AP_RW | MMU_PAGE_S)
+
+#define CACHE_LINE_SIZE     64           // Cortex-A53 L1/L2 line
+
+#define MMU_SECTION_SIZE    0x100000
+#define MMU_RAM_END         0x3F000000   // Start of the peripheral window
+#define MMU_DEVICE_END      0x40100000   // Peripherals + ARM local block
+
+// SCTLR bits
+#define SCTLR_M             (1 << 0)
+#define SCTLR_C             (1 << 2)
+#define SCTLR_Z             (1 << 11)
+#define SCTLR_I             (1 << 12)
+
+// Build the identity map and turn on MMU, caches and branch prediction.
+// Called from boot.S after BSS is cleared, before kernel_main.
+void mmu_init(void);
+
+// Enable the MMU on cores 1-3 using the table built by core 0
+void mmu_enable_secondary(void);
+
+// Verify translation and cache state; prints a report, returns 0 if OK
+int mmu_self_check(void);
+
+/*
+ * Split the 1 MB sections (2 MB blocks on AArch64) covering [start, end)
+ * into tables of 4 KB pages, same mapping. Each one is briefly unmapped on the way
+ * (break-before-make), so only while cores 1-3 are not yet running and
+ * never over the running code or stack. 0 on success.
+ */
+int mmu_split_range(uint32_t start, uint32_t end);
+
+// Unmap / remap one 4 KB page of RAM (stack guard pages). Fails unless
+// its section was split first (mmu_split_range). 0 on success.
+int mmu_guard_page(void* page);
+int mmu_unguard_page(void* page);
+
+// Cache maintenance
+void dcache_clean_range(const void* start, uint32_t len);
+void dcache_invalidate_range(const void* start, uint32_t len);
+void dcache_clean_invalidate_all(void);
+
+// Runtime cache control (used by the benchmark)
+void cache_disable(void);
+void cache_enable(void);
+int cache_enabled(void);
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * page_alloc.c - Buddy allocator for physical pages
+ *
+ * Manages everything from __heap_start up to the end of ARM memory as
+ * reported by the VideoCore mailbox. One state byte per page lives at
+ * the start of that range; free blocks are kept on per-order doubly
+ * linked lists threaded through the free memory itself.
+ */
+
+#include "page_alloc.h"
+#include "mmu.h"
+#include "../../drivers/mailbox/mailbox.h"
+#include "../../drivers/uart/uart.h"
+#include "../../utils/string_utils.h"
+#include "../sync/spin_lock.h"
+
+// page_info[] encoding, only meaningful at the head page of a block
+#define PAGE_FREE       0x80
+#define PAGE_ORDER_MASK 0x1F
+
+// Fallback if the mailbox does not answer
+#define DEFAULT_ARM_MEMORY  0x10000000
+
+typedef struct free_block {
+    struct free_block* next;
+    struct free_block* prev;
+} free_block_t;
+
+extern char __heap_start;
+
+static free_block_t free_lists[PAGE_MAX_ORDER + 1];    // Circular, sentinel heads
+static uint32_t free_blocks[PAGE_MAX_ORDER + 1];
+static uint8_t* page_info;
+static uintptr_t pool_base;
+static uint32_t pool_pages;
+static uint32_t free_pages;
+static uint32_t arm_base;
+static uint32_t arm_size;
+static Spinlock page_lock = SPINLOCK_INIT;
+
+static inline void* page_addr(uint32_t idx) {
+    return (void*)(pool_base + (idx << PAGE_SHIFT));
+}
+
+static void list_add(uint32_t order, uint32_t idx) {
+    free_block_t* block = page_addr(idx);
+    free_block_t* head = &free_lists[order];
+
+    block->next = head->next;
+    block->prev = head;
+    head->next->prev = block;
+    head->next = block;
+
+    page_info[idx] = PAGE_FREE | order;
+    free_blocks[order]++;
+}
+
+static void list_del(uint32_t order, uint32_t idx) {
+    free_block_t* block = page_addr(idx);
+
+    block->prev->next = block->next;
+    block->next->prev = block->prev;
+
+    page_info[idx] = order;
+    free_blocks[order]--;
+}
+
+void page_alloc_init(void) {
+    if (mbox_get_arm_memory(&arm_base, &arm_size) != 0 || arm_size == 0) {
+        uart_puts("MEM: mailbox query failed, assuming 256 MB\n");
+        arm_base = 0;
+        arm_size = DEFAULT_ARM_MEMORY;
+    }
+
+    uint32_t end = arm_base + arm_size;
+    if (end > MMU_RAM_END) {
+        end = MMU_RAM_END;
+    }
+
+    uintptr_t start = ((uintptr_t)&__heap_start + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+    uint32_t total = (end - start) >> PAGE_SHIFT;
+
+    // State bytes first, pool right after
+    uint32_t meta_pages = (total + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    page_info = (uint8_t*)start;
+    pool_base = start + (meta_pages << PAGE_SHIFT);
+    pool_pages = total - meta_pages;
+    free_pages = 0;
+
+    memset(page_info, 0, pool_pages);
+
+    for (uint32_t o = 0; o <= PAGE_MAX_ORDER; o++) {
+        free_lists[o].next = &free_lists[o];
+        free_lists[o].prev = &free_lists[o];
+        free_blocks[o] = 0;
+    }
+
+    // Carve the pool into the largest aligned blocks that fit
+    uint32_t idx = 0;
+    while (idx < pool_pages) {
+        uint32_t order = PAGE_MAX_ORDER;
+        while (order > 0 &&
+               ((idx & ((1u << order) - 1)) || idx + (1u << order) > pool_pages)) {
+            order--;
+        }
+        list_add(order, idx);
+        free_pages += 1u << order;
+        idx += 1u << order;
+    }
+
+    spin_init(&page_lock);
+
+#ifdef STACK_GUARD
+    // Guard pages can land anywhere in the pool; only core 0 runs yet
+    mmu_split_range(pool_base, pool_base + (pool_pages << PAGE_SHIFT));
+#endif
+
+    uart_puts("MEM: ARM memory ");
+    uart_putdec(arm_size >> 20);
+    uart_puts(" MB, page pool ");
+    uart_puthex(pool_base);
+    uart_puts(" - ");
+    uart_puthex(end);
+    uart_puts(" (");
+    uart_putdec(pool_pages);
+    uart_puts(" pages)\n");
+}
+
+void* page_alloc(uint32_t order) {
+    if (order > PAGE_MAX_ORDER) {
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&page_lock);
+
+    // Smallest non-empty list that fits
+    uint32_t o = order;
+    while (o <= PAGE_MAX_ORDER && free_lists[o].next == &free_lists[o]) {
+        o++;
+    }
+    if (o > PAGE_MAX_ORDER) {
+        spin_unlock_irqrestore(&page_lock, flags);
+        return 0;
+    }
+
+    uint32_t idx = ((uintptr_t)free_lists[o].next - pool_base) >> PAGE_SHIFT;
+    list_del(o, idx);
+
+    // Split, returning upper halves to the free lists
+    while (o > order) {
+        o--;
+        list_add(o, idx + (1u << o));
+    }
+
+    page_info[idx] = order;
+    free_pages -= 1u << order;
+
+    spin_unlock_irqrestore(&page_lock, flags);
+    return page_addr(idx);
+}
+
+void page_free(void* addr) {
+    uintptr_t a = (uintptr_t)addr;
+
+    if (a < pool_base || (a & (PAGE_SIZE - 1)) ||
+        ((a - pool_base) >> PAGE_SHIFT) >= pool_pages) {
+        uart_puts("MEM: page_free of bad address ");
+        uart_puthex(a);
+        uart_puts("\n");
+        return;
+    }
+
+    uint32_t idx = (a - pool_base) >> PAGE_SHIFT;
+
+    uint32_t flags = spin_lock_irqsave(&page_lock);
+
+    if (page_info[idx] & PAGE_FREE) {
+        spin_unlock_irqrestore(&page_lock, flags);
+        uart_puts("MEM: double page_free ");
+        uart_puthex(a);
+        uart_puts("\n");
+        return;
+    }
+
+    uint32_t order = page_info[idx] & PAGE_ORDER_MASK;
+    free_pages += 1u << order;
+
+    // Merge with the buddy while it is a free block of the same order
+    while (order < PAGE_MAX_ORDER) {
+        uint32_t buddy = idx ^ (1u << order);
+        if (buddy + (1u << order) > pool_pages ||
+            page_info[buddy] != (PAGE_FREE | order)) {
+            break;
+        }
+        list_del(order, buddy);
+        page_info[buddy] = 0;
+        idx &= buddy;
+        order++;
+    }
+    list_add(order, idx);
+
+    spin_unlock_irqrestore(&page_lock, flags);
+}
+
+// Returns PAGE_MAX_ORDER + 1 when size is too large to ever fit
+uint32_t page_order_for(uint32_t size) {
+    uint32_t order = 0;
+    while (order <= PAGE_MAX_ORDER && ((uint32_t)PAGE_SIZE << order) < size) {
+        order++;
+    }
+    return order;
+}
+
+void page_get_stats(page_stats_t* stats) {
+    uint32_t flags = spin_lock_irqsave(&page_lock);
+
+    stats->arm_base = arm_base;
+    stats->arm_size = arm_size;
+    stats->pool_start = pool_base;
+    stats->pool_end = pool_base + (pool_pages << PAGE_SHIFT);
+    stats->total_pages = pool_pages;
+    stats->free_pages = free_pages;
+    for (uint32_t o = 0; o <= PAGE_MAX_ORDER; o++) {
+        stats->free_blocks[o] = free_blocks[o];
+    }
+
+    spin_unlock_irqrestore(&page_lock, flags);
+}
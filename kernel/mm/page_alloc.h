@@ -0,0 +1,34 @@
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stdint.h>
+
+#define PAGE_SHIFT      12
+#define PAGE_SIZE       (1 << PAGE_SHIFT)
+#define PAGE_MAX_ORDER  10      // Largest block: 2^10 pages = 4 MB
+
+typedef struct {
+    uint32_t arm_base;          // ARM memory reported by the firmware
+    uint32_t arm_size;
+    uint32_t pool_start;        // Managed range
+    uint32_t pool_end;
+    uint32_t total_pages;
+    uint32_t free_pages;
+    uint32_t free_blocks[PAGE_MAX_ORDER + 1];
+} page_stats_t;
+
+// Query ARM memory size and hand __heap_start..end to the buddy allocator
+void page_alloc_init(void);
+
+// 2^order contiguous pages, or 0 when out of memory. O(log n).
+void* page_alloc(uint32_t order);
+
+// Return a block from page_alloc (order is remembered). Coalesces buddies.
+void page_free(void* addr);
+
+// Smallest order whose block holds size bytes
+uint32_t page_order_for(uint32_t size);
+
+void page_get_stats(page_stats_t* stats);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * slab.c - Fixed-size object caches
+ *
+ * Each slab is one page from the buddy allocator: a small header with an
+ * index free list (bufctl[]), then objects packed at the cache alignment.
+ * Keeping the free list out of the objects means constructed state
+ * survives free/alloc, so constructors only run when a slab is created.
+ *
+ * Slabs move between partial, full and empty lists; one empty slab is
+ * kept per cache to absorb alloc/free churn, further ones are released.
+ */
+
+#include "slab.h"
+#include "page_alloc.h"
+#include "kmalloc.h"
+#include "mmu.h"
+#include "alloc_trace.h"
+#include "../../drivers/uart/uart.h"
+#include "../../utils/string_utils.h"
+#include "../sync/spin_lock.h"
+
+#define BUFCTL_END      0xFFFF
+#define BUFCTL_INUSE    0xFFFE
+
+typedef struct slab {
+    struct slab* next;
+    struct slab* prev;
+    kmem_cache_t* cache;
+    uint16_t inuse;
+    uint16_t free;              // First free index or BUFCTL_END
+    uint16_t bufctl[];          // Next free index, or BUFCTL_INUSE
+} slab_t;
+
+struct kmem_cache {
+    char name[SLAB_NAME_LEN];
+    uint32_t size;
+    uint32_t per_slab;
+    uint32_t obj_offset;        // First object, from the slab start
+    slab_ctor_t ctor;
+
+    slab_t* partial;
+    slab_t* full;
+    slab_t* empty;
+    uint32_t slabs;
+    uint32_t empty_slabs;
+    uint32_t active;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t frees;
+
+    Spinlock lock;
+    struct kmem_cache* next;
+};
+
+static kmem_cache_t* cache_list;
+static Spinlock cache_list_lock = SPINLOCK_INIT;
+
+static inline uint32_t align_up(uint32_t v, uint32_t a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+static void slab_push(slab_t** head, slab_t* s) {
+    s->prev = 0;
+    s->next = *head;
+    if (*head) {
+        (*head)->prev = s;
+    }
+    *head = s;
+}
+
+static void slab_unlink(slab_t** head, slab_t* s) {
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        *head = s->next;
+    }
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+}
+
+static inline uint8_t* slab_obj(kmem_cache_t* c, slab_t* s, uint32_t idx) {
+    return (uint8_t*)s + c->obj_offset + idx * c->size;
+}
+
+// New page: chain every index on the free list and construct objects
+static slab_t* slab_grow(kmem_cache_t* c) {
+    slab_t* s = page_alloc(0);
+    if (!s) {
+        return 0;
+    }
+
+    s->cache = c;
+    s->inuse = 0;
+    s->free = 0;
+    for (uint32_t i = 0; i < c->per_slab; i++) {
+        s->bufctl[i] = (i + 1 < c->per_slab) ? (uint16_t)(i + 1) : BUFCTL_END;
+        if (c->ctor) {
+            c->ctor(slab_obj(c, s, i));
+        }
+    }
+
+    c->slabs++;
+    return s;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align,
+                                slab_ctor_t ctor) {
+    if (align == 0) {
+        align = KMALLOC_ALIGN;
+    }
+    if (size == 0 || size > SLAB_MAX_OBJ || (align & (align - 1)) || align > CACHE_LINE_SIZE) {
+        uart_puts("SLAB: bad cache parameters for ");
+        uart_puts(name);
+        uart_puts("\n");
+        return 0;
+    }
+
+    kmem_cache_t* c = kmalloc(sizeof(kmem_cache_t));
+    if (!c) {
+        return 0;
+    }
+    memset(c, 0, sizeof(*c));
+
+    str_copy(c->name, name, SLAB_NAME_LEN);
+    c->size = align_up(size, align);
+    c->ctor = ctor;
+
+    // Largest count whose header + objects fit in a page
+    uint32_t n = (PAGE_SIZE - sizeof(slab_t)) / (c->size + sizeof(uint16_t));
+    while (align_up(sizeof(slab_t) + n * sizeof(uint16_t), align) + n * c->size > PAGE_SIZE) {
+        n--;
+    }
+    c->per_slab = n;
+    c->obj_offset = align_up(sizeof(slab_t) + n * sizeof(uint16_t), align);
+    spin_init(&c->lock);
+
+    uint32_t flags = spin_lock_irqsave(&cache_list_lock);
+    c->next = cache_list;
+    cache_list = c;
+    spin_unlock_irqrestore(&cache_list_lock, flags);
+
+    return c;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* c) {
+    uint32_t flags = spin_lock_irqsave(&c->lock);
+
+    slab_t* s = c->partial;
+    if (s) {
+        c->hits++;
+    } else if ((s = c->empty) != 0) {
+        slab_unlink(&c->empty, s);
+        slab_push(&c->partial, s);
+        c->empty_slabs--;
+        c->hits++;
+    } else {
+        s = slab_grow(c);
+        if (!s) {
+            spin_unlock_irqrestore(&c->lock, flags);
+            return 0;
+        }
+        slab_push(&c->partial, s);
+        c->misses++;
+    }
+
+    uint32_t idx = s->free;
+    s->free = s->bufctl[idx];
+    s->bufctl[idx] = BUFCTL_INUSE;
+    s->inuse++;
+    c->active++;
+
+    if (s->inuse == c->per_slab) {
+        slab_unlink(&c->partial, s);
+        slab_push(&c->full, s);
+    }
+
+    spin_unlock_irqrestore(&c->lock, flags);
+
+    void* obj = slab_obj(c, s, idx);
+    alloc_trace_alloc(obj, c->size, __builtin_return_address(0));
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* c, void* obj) {
+    if (!obj) {
+        return;
+    }
+
+    // Slabs are single pages, so the header is at the page base
+    slab_t* s = (slab_t*)((uintptr_t)obj & ~(uintptr_t)(PAGE_SIZE - 1));
+    uint32_t off = (uintptr_t)obj - (uintptr_t)s - c->obj_offset;
+    uint32_t idx = off / c->size;
+
+    if (s->cache != c || (uintptr_t)obj < (uintptr_t)s + c->obj_offset ||
+        off % c->size || idx >= c->per_slab) {
+        uart_puts("SLAB: bad free to ");
+        uart_puts(c->name);
+        uart_puts(": ");
+        uart_puthex((uintptr_t)obj);
+        uart_puts("\n");
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&c->lock);
+
+    if (s->bufctl[idx] != BUFCTL_INUSE) {
+        spin_unlock_irqrestore(&c->lock, flags);
+        uart_puts("SLAB: double free to ");
+        uart_puts(c->name);
+        uart_puts("\n");
+        return;
+    }
+
+    if (s->inuse == c->per_slab) {
+        slab_unlink(&c->full, s);
+        slab_push(&c->partial, s);
+    }
+
+    alloc_trace_free(obj);
+    s->bufctl[idx] = s->free;
+    s->free = (uint16_t)idx;
+    s->inuse--;
+    c->active--;
+    c->frees++;
+
+    if (s->inuse == 0) {
+        slab_unlink(&c->partial, s);
+        if (c->empty_slabs == 0) {
+            slab_push(&c->empty, s);
+            c->empty_slabs++;
+        } else {
+            c->slabs--;
+            page_free(s);
+        }
+    }
+
+    spin_unlock_irqrestore(&c->lock, flags);
+}
+
+int slab_get_stats(uint32_t index, slab_stats_t* stats) {
+    uint32_t flags = spin_lock_irqsave(&cache_list_lock);
+
+    kmem_cache_t* c = cache_list;
+    while (c && index--) {
+        c = c->next;
+    }
+
+    if (!c) {
+        spin_unlock_irqrestore(&cache_list_lock, flags);
+        return -1;
+    }
+
+    uint32_t cflags = spin_lock_irqsave(&c->lock);
+    str_copy(stats->name, c->name, SLAB_NAME_LEN);
+    stats->obj_size = c->size;
+    stats->per_slab = c->per_slab;
+    stats->slabs = c->slabs;
+    stats->active = c->active;
+    stats->total = c->slabs * c->per_slab;
+    stats->hits = c->hits;
+    stats->misses = c->misses;
+    stats->frees = c->frees;
+    spin_unlock_irqrestore(&c->lock, cflags);
+
+    spin_unlock_irqrestore(&cache_list_lock, flags);
+    return 0;
+}
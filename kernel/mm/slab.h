@@ -0,0 +1,39 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+
+#define SLAB_NAME_LEN   16
+#define SLAB_MAX_OBJ    1024    // Slabs are single pages; bigger goes to kmalloc
+
+typedef struct kmem_cache kmem_cache_t;
+
+// Runs once per object when its slab is created. Objects must be handed
+// back to kmem_cache_free in the constructed state.
+typedef void (*slab_ctor_t)(void* obj);
+
+typedef struct {
+    char name[SLAB_NAME_LEN];
+    uint32_t obj_size;          // After alignment
+    uint32_t per_slab;
+    uint32_t slabs;
+    uint32_t active;            // Objects handed out
+    uint32_t total;             // Objects in all slabs
+    uint32_t hits;              // Served from an existing slab
+    uint32_t misses;            // Needed a new page
+    uint32_t frees;
+} slab_stats_t;
+
+// align: 0 for KMALLOC_ALIGN, CACHE_LINE_SIZE for objects touched per tick.
+// Returns 0 if size is too large or out of memory.
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align,
+                                slab_ctor_t ctor);
+
+// O(1) apart from taking a fresh page on a miss
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+// Iterate caches for reporting; returns -1 past the last one
+int slab_get_stats(uint32_t index, slab_stats_t* stats);
+
+#endif
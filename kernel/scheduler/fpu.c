@@ -0,0 +1,118 @@
+#include "fpu.h"
+#include "../../drivers/uart/uart.h"
+#include "../../utils/string_utils.h"
+#include "../smp/smp.h"
+#include "../mm/slab.h"
+#include "../hot.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Mode the kernel and its tasks run in: SVC, or EL1h on AArch64
+#ifdef __aarch64__
+#define MODE_MASK   0xF
+#define MODE_SVC    0x5
+#else
+#define MODE_MASK   0x1F
+#define MODE_SVC    0x13
+#endif
+
+static Task* fpu_owner[NUM_CORES];      // Registers loaded on each core
+static kmem_cache_t* fpu_cache;
+static atomic_uint fpu_traps;
+
+static void undef_fatal(const char* why, uint32_t spsr, uint32_t pc) {
+    uart_puts("\n*** Undefined instruction on core ");
+    uart_putdec(cpu_id());
+    uart_puts(": PC ");
+    uart_puthex(pc);
+    uart_puts(", SPSR ");
+    uart_puthex(spsr);
+    uart_puts(" (");
+    uart_puts(why);
+    uart_puts(")\n");
+
+    while (1) {
+        __asm__ __volatile__("wfe");
+    }
+}
+
+void fpu_init(void) {
+    uint32_t core = cpu_id();
+
+#ifndef __aarch64__
+    // CPACR: full access to CP10 and CP11
+    uint32_t cpacr;
+    __asm__ __volatile__("mrc p15, 0, %0, c1, c0, 2" : "=r"(cpacr));
+    cpacr |= (0xF << 20);
+    __asm__ __volatile__("mcr p15, 0, %0, c1, c0, 2" :: "r"(cpacr));
+    __asm__ __volatile__("isb" ::: "memory");
+#endif
+
+    // Off until someone uses it
+    fpexc_write(0);
+    fpu_owner[core] = NULL;
+
+    if (core == 0) {
+        fpu_cache = kmem_cache_create("FPU", sizeof(FpuContext), 0, 0);
+        if (!fpu_cache) {
+            uart_puts("FPU: Out of memory for the context cache\n");
+        }
+    }
+}
+
+HOT void fpu_switch(Task* next) {
+    fpexc_write(next == fpu_owner[cpu_id()] ? FPEXC_EN : 0);
+}
+
+void undef_c(uint32_t spsr, uint32_t pc) {
+    uint32_t core = cpu_id();
+
+    // Already enabled: a genuinely undefined instruction
+    if (fpexc_read() & FPEXC_EN) {
+        undef_fatal("not an FPU trap", spsr, pc);
+    }
+    if ((spsr & MODE_MASK) != MODE_SVC) {
+        undef_fatal("FPU used outside task context", spsr, pc);
+    }
+
+    fpexc_write(FPEXC_EN);
+
+    Task* cur = task_current();
+    Task* owner = fpu_owner[core];
+    if (owner == cur) {
+        return;
+    }
+
+    if (owner) {
+        fpu_save(owner->fpu);
+    }
+
+    if (cur) {
+        if (!cur->fpu) {
+            // First use: start from zeroed registers
+            cur->fpu = fpu_cache ? kmem_cache_alloc(fpu_cache) : NULL;
+            if (!cur->fpu) {
+                undef_fatal("no memory for FPU context", spsr, pc);
+            }
+            memset(cur->fpu, 0, sizeof(FpuContext));
+        }
+        fpu_restore(cur->fpu);
+    }
+
+    fpu_owner[core] = cur;
+    atomic_fetch_add(&fpu_traps, 1);
+}
+
+void fpu_release(Task* task) {
+    if (fpu_owner[task->cpu] == task) {
+        fpu_owner[task->cpu] = NULL;
+    }
+    if (task->fpu) {
+        kmem_cache_free(fpu_cache, task->fpu);
+        task->fpu = NULL;
+    }
+}
+
+uint32_t fpu_trap_count(void) {
+    return atomic_load(&fpu_traps);
+}
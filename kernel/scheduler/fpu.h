@@ -0,0 +1,61 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+#include "task.h"
+
+/*
+ * Lazy VFP/NEON context switching.
+ *
+ * The FPU is left disabled (FPEXC.EN = 0) for every task except the one
+ * whose registers are currently loaded on this core. Its first FP or
+ * NEON instruction traps to the undefined-instruction vector, which
+ * saves the previous owner's d0-d31/FPSCR, loads this task's and
+ * retries the instruction. Tasks that never use the FPU never pay for
+ * it. FP/NEON code must not run in IRQ handlers.
+ */
+
+#ifdef __aarch64__
+// AArch64: CPACR_EL1.FPEN plays the part of FPEXC.EN, and the trap
+// arrives as a sync exception (ESR EC 0x07) instead of undef
+typedef struct FpuContext {
+    uint64_t v[64];             // q0-q31
+    uint32_t fpsr;
+    uint32_t fpcr;
+} FpuContext;
+#else
+typedef struct FpuContext {
+    uint64_t d[32];
+    uint32_t fpscr;
+} FpuContext;
+#endif
+
+// Per core: grant CP10/CP11 access, leave FPEXC.EN clear
+void fpu_init(void);
+
+// From switch_to_locked: enable the FPU only if next owns the registers
+void fpu_switch(Task* next);
+
+// From the undef vector (UND mode, IRQs masked). Returns only when the
+// faulting instruction should be retried. On AArch64 it comes from the
+// sync vector, and IRQ handlers share EL1h with tasks, so only
+// -mgeneral-regs-only keeps them off the FPU there.
+void undef_c(uint32_t spsr, uint32_t pc);
+
+// Task is being freed: drop ownership and its saved context
+void fpu_release(Task* task);
+
+// Lazy switches taken on all cores
+uint32_t fpu_trap_count(void);
+
+// Implemented in fpu.S (arch/aarch64/fpu.S)
+void fpu_save(FpuContext* ctx);
+void fpu_restore(const FpuContext* ctx);
+uint32_t fpexc_read(void);
+void fpexc_write(uint32_t val);
+void fpu_fill(uint32_t pattern);        // d0-d31 = pattern
+int fpu_verify(uint32_t pattern);       // 0 if d0-d31 still hold it
+
+#define FPEXC_EN    (1u << 30)
+
+#endif
@@ -1,14 +1,105 @@
 #include "task.h"
 #include "../../drivers/uart/uart.h"
 #include "../interrupts/interrupts.h"
+#include "../smp/smp.h"
+#include "../sync/spin_lock.h"
+#include "../mm/kmalloc.h"
+#include "../mm/slab.h"
+#include "../mm/mmu.h"
+#include "../mm/page_alloc.h"
+#include "fpu.h"
+#include "../hot.h"
+#include "../../utils/cycles.h"
 #include <stddef.h>
 
-static Task tasks[MAX_TASKS];
-static int current_task_index = -1;
-static int scheduler_running = 0;
+typedef struct {
+    Task* head;
+    Task* tail;
+} TaskList;
 
-// Pointer to current task's SP storage (for IRQ handler)
-uint32_t** current_sp_ptr = NULL;
+/*
+ * Per-core run queue. Tasks never migrate: each one belongs to the core
+ * it was created on, and only that core switches to it. The lock guards
+ * the lists and the state of every task on the core.
+ *
+ * Ready tasks wait on a FIFO per priority; bit p of ready_mask is set
+ * while ready[p] is non-empty, so the pick is one CLZ and a list pop
+ * however many tasks exist. The running task is on no list: a tick
+ * appends it behind its peers, which gives round-robin within a level.
+ * Sleepers are on the core's timer wheel, so a tick only looks at the
+ * slot that is due; callback timers share the wheel and run in the
+ * core's "timers" task.
+ *
+ * Fair tasks wait in a leftist min-heap on vruntime instead: insert and
+ * pop are O(log n) worst case with no array to size. Every pick charges
+ * the outgoing task the PMU cycles since the previous pick. Periodic
+ * tasks use a second heap, keyed on absolute deadline (EDF), and sleep
+ * on the wheel between releases. When every queue is empty the
+ * core's idle task runs.
+ */
+typedef struct {
+    Spinlock lock;
+    Task* current;      // Running task (NULL = boot context)
+    Task* idle;         // On no queue; picked when nothing else can run
+    uint32_t ready_mask;
+    uint32_t clock;     // cycles() at the last pick
+    Task* rt_root;      // Ready periodic task with the earliest deadline
+    Task* fair_root;    // Ready fair task with the least vruntime
+    uint64_t min_vruntime;  // Never decreases; placement for new and woken tasks
+    uint32_t count;     // Live tasks on this core
+    int running;        // Scheduler started on this core
+    Task* zombies;      // Exited tasks, freed at the next switch here
+    uint32_t rt_density;    // Admitted periodic tasks, per-mille
+    Timer* timers_due;  // Expired callback timers, for timer_task
+    Timer* timer_running;   // Callback timer_task is in, for timer_cancel_sync
+    Task* timer_task;
+    TaskList ready[TASK_PRIO_LEVELS];
+    TimerWheel wheel;   // Sleeping tasks and callback timers
+} __attribute__((aligned(CACHE_LINE_SIZE))) RunQueue;   // Hot fields in the first line
+
+// IRQ-to-switch timing for bench sched
+typedef struct {
+    uint32_t enabled;
+    uint32_t entry;     // cycles() at irq_handler_c entry
+    SwitchTiming stats;
+} __attribute__((aligned(CACHE_LINE_SIZE))) SwitchClock;
+
+#define PSR_MODE_SVC    0x13
+#define PSR_THUMB       0x20
+#define PSR_MODE_EL1H   0x5
+
+// Idle task: its loop plus an IRQ frame and a switch, at -O0 too
+#define IDLE_STACK_SIZE 2048
+
+// AArch64 context frame, in 64-bit words
+#define FRAME64_WORDS   34
+#define FRAME64_ELR     31
+#define FRAME64_SPSR    32
+
+// A woken fair task may sit this far behind min_vruntime, so sleepers
+// run promptly without banking their whole sleep (half a tick at 1 GHz)
+#define FAIR_WAKE_CREDIT    ((uint64_t)TIMER_INTERVAL * 1000 / 2)
+
+// Weight per nice level, -20..19; each step is about 10% of CPU
+static const uint32_t nice_weights[TASK_NICE_MAX - TASK_NICE_MIN + 1] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,   335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+static kmem_cache_t* task_cache;
+static Task* all_tasks;                         // Every live task, for ps
+static uint32_t next_task_id;
+static RunQueue runqueues[NUM_CORES] HOT_DATA;
+static SwitchClock switch_clock[NUM_CORES] HOT_DATA;
+static Spinlock tasks_lock = SPINLOCK_INIT;     // all_tasks and ids
+static volatile int scheduler_running = 0;
+static volatile int tickless = CONFIG_TICKLESS;
+static volatile uint32_t idle_time[NUM_CORES];  // us in WFI
+
+// Pointer to current task's SP storage, per core (for IRQ handler)
+uint32_t** current_sp_ptr[NUM_CORES] HOT_DATA;
 
 static void str_copy(char* dst, const char* src, int max) {
     int i = 0;
@@ -20,17 +111,323 @@ static void str_copy(char* dst, const char* src, int max) {
 }
 
 void scheduler_init(void) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        tasks[i].state = TASK_UNUSED;
-        tasks[i].id = i;
-        tasks[i].stack_pointer = NULL;
-        tasks[i].priority = 0;
-        tasks[i].name[0] = '\0';
-    }
-    current_task_index = -1;
+    task_cache = kmem_cache_create("Task", sizeof(Task), CACHE_LINE_SIZE, 0);
+    if (!task_cache) {
+        // Every task_create then fails and scheduler_start has nothing to run
+        uart_puts("Scheduler: Out of memory for the task cache\n");
+    }
+    all_tasks = NULL;
+    next_task_id = 0;
+
+    for (int c = 0; c < NUM_CORES; c++) {
+        spin_init(&runqueues[c].lock);
+        runqueues[c].current = NULL;
+        runqueues[c].idle = NULL;
+        runqueues[c].ready_mask = 0;
+        runqueues[c].clock = 0;
+        runqueues[c].rt_root = NULL;
+        runqueues[c].fair_root = NULL;
+        runqueues[c].rt_density = 0;
+        runqueues[c].min_vruntime = 0;
+        runqueues[c].count = 0;
+        runqueues[c].running = 0;
+        runqueues[c].zombies = NULL;
+        runqueues[c].timers_due = NULL;
+        runqueues[c].timer_running = NULL;
+        runqueues[c].timer_task = NULL;
+        wheel_init(&runqueues[c].wheel, timer_ticks);
+        for (int p = 0; p < TASK_PRIO_LEVELS; p++) {
+            runqueues[c].ready[p].head = NULL;
+            runqueues[c].ready[p].tail = NULL;
+        }
+        current_sp_ptr[c] = NULL;
+    }
+    spin_init(&tasks_lock);
     scheduler_running = 0;
-    current_sp_ptr = NULL;
-    uart_puts("Scheduler initialized.\n");
+    log_puts("Scheduler initialized.\n");
+}
+
+#ifdef STACK_GUARD
+// Page-backed stack whose lowest page is unmapped; size grows to fill
+// the buddy block
+static uint32_t* stack_alloc(uint32_t* size) {
+    uint32_t order = page_order_for(*size + PAGE_SIZE);
+    uint8_t* block = page_alloc(order);
+
+    if (!block) {
+        return NULL;
+    }
+    if (mmu_guard_page(block) != 0) {
+        page_free(block);
+        return NULL;
+    }
+    *size = ((uint32_t)PAGE_SIZE << order) - PAGE_SIZE;
+    return (uint32_t*)(block + PAGE_SIZE);
+}
+
+static void stack_free(uint32_t* stack) {
+    uint8_t* block = (uint8_t*)stack - PAGE_SIZE;
+    mmu_unguard_page(block);
+    page_free(block);
+}
+#else
+static uint32_t* stack_alloc(uint32_t* size) {
+    return kmalloc(*size);
+}
+
+static void stack_free(uint32_t* stack) {
+    kfree(stack);
+}
+#endif
+
+// Canaries at the bottom, pattern everywhere else
+static void stack_paint(uint32_t* stack, uint32_t size) {
+    uint32_t words = size / 4;
+    for (uint32_t i = 0; i < words; i++) {
+        stack[i] = (i < STACK_CANARY_WORDS) ? STACK_CANARY : STACK_PAINT;
+    }
+}
+
+uint32_t task_stack_peak(const Task* task) {
+    uint32_t words = task->stack_size / 4;
+    uint32_t i = STACK_CANARY_WORDS;
+
+    while (i < words && task->stack[i] == STACK_PAINT) {
+        i++;
+    }
+    return (words - i) * 4;
+}
+
+// Heap order within one class; the two heaps never mix
+static inline int heap_before(const Task* a, const Task* b) {
+    if (a->policy == TASK_POLICY_RT) {
+        return (int32_t)(a->deadline - b->deadline) < 0;
+    }
+    return a->vruntime < b->vruntime;
+}
+
+// Leftist heap merge; recursion follows right spines, O(log n) deep
+static HOT Task* heap_merge(Task* a, Task* b) {
+    if (!a) {
+        return b;
+    }
+    if (!b) {
+        return a;
+    }
+    if (heap_before(b, a)) {
+        Task* t = a;
+        a = b;
+        b = t;
+    }
+
+    a->heap_right = heap_merge(a->heap_right, b);
+    uint32_t left_rank = a->heap_left ? a->heap_left->heap_rank : 0;
+    if (left_rank < a->heap_right->heap_rank) {
+        Task* t = a->heap_left;
+        a->heap_left = a->heap_right;
+        a->heap_right = t;
+    }
+    a->heap_rank = a->heap_right ? a->heap_right->heap_rank + 1 : 1;
+    return a;
+}
+
+// Caller holds rq->lock; *root must be non-empty
+static HOT Task* heap_pop(Task** root) {
+    Task* task = *root;
+
+    *root = heap_merge(task->heap_left, task->heap_right);
+    return task;
+}
+
+// Caller holds rq->lock. Append at the tail of the task's level, or
+// insert into the class heap.
+static HOT void rq_enqueue(RunQueue* rq, Task* task) {
+    if (task->policy == TASK_POLICY_IDLE) {
+        return;
+    }
+    if (task->policy != TASK_POLICY_PRIO) {
+        task->heap_left = NULL;
+        task->heap_right = NULL;
+        task->heap_rank = 1;
+        if (task->policy == TASK_POLICY_RT) {
+            rq->rt_root = heap_merge(rq->rt_root, task);
+        } else {
+            rq->fair_root = heap_merge(rq->fair_root, task);
+        }
+        return;
+    }
+
+    TaskList* list = &rq->ready[task->priority];
+
+    task->next = NULL;
+    if (list->tail) {
+        list->tail->next = task;
+    } else {
+        list->head = task;
+    }
+    list->tail = task;
+    rq->ready_mask |= 1u << task->priority;
+}
+
+// Highest non-empty level; mask must be non-zero
+static inline uint32_t rq_top(uint32_t mask) {
+    return 31 - __builtin_clz(mask);
+}
+
+// Caller holds rq->lock; ready[prio] must be non-empty
+static HOT Task* rq_pop(RunQueue* rq, uint32_t prio) {
+    TaskList* list = &rq->ready[prio];
+    Task* task = list->head;
+
+    list->head = task->next;
+    if (!list->head) {
+        list->tail = NULL;
+        rq->ready_mask &= ~(1u << prio);
+    }
+    return task;
+}
+
+// Caller holds rq->lock. Wakes the task at tick sleep_until.
+static void sleep_arm(RunQueue* rq, Task* task) {
+    task->sleep_timer.expires = task->sleep_until;
+    wheel_add(&rq->wheel, &task->sleep_timer);
+}
+
+/*
+ * Caller holds rq->lock. Before the core has its idle task, a sleep that
+ * schedule() found nothing to run instead of leaves the task running but
+ * still on the wheel; drop it before the task changes state any other
+ * way.
+ */
+static void sleep_cancel(RunQueue* rq, Task* task) {
+    if (timer_queued(&task->sleep_timer)) {
+        wheel_del(&rq->wheel, &task->sleep_timer);
+    }
+}
+
+// Caller holds rq->lock. Starts a periodic task's job at release.
+static HOT void rt_release(Task* task, uint32_t tick) {
+    task->rt.awaiting = 0;
+    task->rt.release = tick;
+    task->rt.release_us = *SYSTIMER_CLO;
+    task->rt.used = 0;
+    task->deadline = tick + task->rt.deadline;
+}
+
+/*
+ * Caller holds rq->lock. Parks a periodic task until its next release
+ * that is not already past; skipped releases count as misses.
+ */
+static void rt_await_release(RunQueue* rq, Task* task) {
+    uint32_t next = task->rt.release + task->rt.period;
+
+    while ((int32_t)(next - timer_ticks) < 0) {
+        next += task->rt.period;
+        task->rt.misses++;
+    }
+    task->rt.awaiting = 1;
+    task->state = TASK_SLEEPING;
+    task->sleep_until = next;
+    sleep_arm(rq, task);
+}
+
+// Caller holds rq->lock. A tickless idle core takes no interrupt until
+// its next sleeper is due, so work queued from another core needs an IPI.
+static void rq_kick(RunQueue* rq, uint32_t cpu) {
+    if (rq->current && rq->current == rq->idle && cpu != cpu_id()) {
+        smp_send_ipi(cpu, IPI_RESCHED);
+    }
+}
+
+// Caller holds rq->lock. Ready again after a sleep or a block; a fair
+// task keeps its vruntime unless it is far behind the others. Every
+// wakeup comes through here, so a parked task is never requeued.
+static HOT void rq_wake(RunQueue* rq, Task* task) {
+    if (task->state == TASK_PARKED) {
+        return;
+    }
+    if (task->policy == TASK_POLICY_FAIR &&
+        task->vruntime + FAIR_WAKE_CREDIT < rq->min_vruntime) {
+        task->vruntime = rq->min_vruntime - FAIR_WAKE_CREDIT;
+    } else if (task->policy == TASK_POLICY_RT && task->rt.awaiting) {
+        rt_release(task, task->sleep_until);
+    }
+    task->state = TASK_READY;
+    rq_enqueue(rq, task);
+}
+
+// Caller holds rq->lock. Runs the wheel up to the current tick: sleepers
+// wake here, callback timers are handed to the core's timer task.
+static HOT void timers_expire(RunQueue* rq) {
+    Timer* t = wheel_advance(&rq->wheel, timer_ticks);
+
+    while (t) {
+        Timer* next = t->next;
+        if (t->func) {
+            timer_list_push(&rq->timers_due, t);
+        } else {
+            rq_wake(rq, (Task*)t->arg);
+        }
+        t = next;
+    }
+
+    Task* worker = rq->timer_task;
+    if (rq->timers_due && worker && worker->state == TASK_BLOCKED) {
+        rq_wake(rq, worker);
+    }
+}
+
+// Caller holds rq->lock. Charges prev for the cycles since the last pick.
+static HOT void sched_account(RunQueue* rq, Task* prev) {
+    uint32_t now = cycles();
+    uint32_t delta = now - rq->clock;
+
+    rq->clock = now;
+    if (!prev) {
+        return;
+    }
+    prev->runtime += delta;
+    if (prev->policy == TASK_POLICY_FAIR) {
+        prev->vruntime += ((uint64_t)delta * prev->fair_inv) >> 16;
+    } else if (prev->policy == TASK_POLICY_RT) {
+        prev->rt.used += *SYSTIMER_CLO - prev->rt.since;
+    }
+}
+
+/*
+ * Caller holds the task's rq lock. A broken canary means the task has
+ * already written below its stack; park it so it cannot do more damage.
+ * TASK_PARKED is terminal; rq_wake ignores it, so a late task_wake or
+ * timer wakeup cannot requeue the task.
+ */
+static HOT void stack_check(RunQueue* rq, Task* task) {
+    if (task->overflowed) {
+        return;
+    }
+    for (uint32_t i = 0; i < STACK_CANARY_WORDS; i++) {
+        if (task->stack[i] != STACK_CANARY) {
+            task->overflowed = 1;
+            sleep_cancel(rq, task);
+            task->state = TASK_PARKED;
+            uart_puts("\nScheduler: stack overflow in task '");
+            uart_puts(task->name);
+            uart_puts("', task parked\n");
+            return;
+        }
+    }
+}
+
+const char* task_guard_owner(uint32_t addr) {
+#ifdef STACK_GUARD
+    for (Task* t = all_tasks; t; t = t->all_next) {
+        if (addr - ((uintptr_t)t->stack - PAGE_SIZE) < PAGE_SIZE) {
+            return t->name;
+        }
+    }
+#else
+    (void)addr;
+#endif
+    return NULL;
 }
 
 static void task_wrapper(TaskFunction func) {
@@ -39,24 +436,129 @@ static void task_wrapper(TaskFunction func) {
     task_exit();
 }
 
-int task_create(const char* name, TaskFunction func, uint32_t priority) {
-    int slot = -1;
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_UNUSED) {
-            slot = i;
-            break;
+// Online and running the scheduler (not the storage core)
+static int cpu_schedulable(uint32_t cpu) {
+#ifdef SD_SERVICE_CORE
+    if (cpu == SD_SERVICE_CORE) {
+        return 0;
+    }
+#endif
+    return cpu < NUM_CORES && smp_core_online(cpu);
+}
+
+// Least loaded schedulable core
+static uint32_t pick_cpu(void) {
+    uint32_t best = 0;
+    for (uint32_t c = 1; c < NUM_CORES; c++) {
+        if (cpu_schedulable(c) && runqueues[c].count < runqueues[best].count) {
+            best = c;
         }
     }
-    
-    if (slot == -1) {
-        uart_puts("Scheduler: No free task slots!\n");
+    return best;
+}
+
+int task_create(const char* name, TaskFunction func, uint32_t priority) {
+    return task_create_on(name, func, priority, TASK_CPU_ANY);
+}
+
+int task_create_on(const char* name, TaskFunction func, uint32_t priority, uint32_t cpu) {
+    return task_create_sized(name, func, priority, cpu, TASK_STACK_SIZE);
+}
+
+uint32_t task_nice_weight(int nice) {
+    if (nice < TASK_NICE_MIN) {
+        nice = TASK_NICE_MIN;
+    } else if (nice > TASK_NICE_MAX) {
+        nice = TASK_NICE_MAX;
+    }
+    return nice_weights[nice - TASK_NICE_MIN];
+}
+
+// param is the priority for TASK_POLICY_PRIO, the nice value for FAIR;
+// rt is set for TASK_POLICY_RT only. An IDLE task becomes its core's idle
+// task and is not counted.
+static int task_create_with(const char* name, TaskFunction func, uint32_t cpu,
+                            uint32_t stack_size, TaskPolicy policy, int param,
+                            const TaskRt* rt) {
+    stack_size = (stack_size + 7) & ~7u;    // AAPCS: 8-byte aligned SP
+    if (stack_size < TASK_STACK_MIN) {
+        stack_size = TASK_STACK_MIN;
+    }
+
+    Task* task = task_cache ? kmem_cache_alloc(task_cache) : NULL;
+    uint32_t* stack = task ? stack_alloc(&stack_size) : NULL;
+
+    if (!task || !stack) {
+        kmem_cache_free(task_cache, task);  // NULL-safe
+        uart_puts("Scheduler: Out of memory for task '");
+        uart_puts(name);
+        uart_puts("'\n");
         return -1;
     }
-    
-    Task* task = &tasks[slot];
-    task->priority = priority;
+
+    if (cpu == TASK_CPU_ANY || !cpu_schedulable(cpu)) {
+        cpu = pick_cpu();
+    }
+
+    task->state = TASK_BLOCKED;             // Not runnable until queued
+    task->policy = policy;
+    if (policy == TASK_POLICY_FAIR) {
+        task->priority = 0;
+        task->nice = (int8_t)param;
+        task->fair_inv = ((uint32_t)TASK_WEIGHT_NICE_0 << 16) / task_nice_weight(param);
+    } else {
+        task->priority = param;
+        task->nice = 0;
+        task->fair_inv = 1u << 16;
+    }
+    task->vruntime = 0;
+    task->runtime = 0;
+    task->cpu = cpu;
+    if (rt) {
+        task->rt = *rt;
+    }
+    task->next = NULL;
+    task->stack = stack;
+    task->stack_size = stack_size;
+    task->overflowed = 0;
+    task->fpu = NULL;
+    stack_paint(stack, stack_size);
     str_copy(task->name, name, TASK_NAME_LEN);
-    
+    task->sleep_timer.next = NULL;
+    task->sleep_timer.pprev = NULL;
+    task->sleep_timer.func = NULL;          // Wakes the task, see timers_expire
+    task->sleep_timer.arg = task;
+    task->sleep_timer.cpu = cpu;
+    task->sleep_timer.slot = WHEEL_NONE;
+
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    task->id = next_task_id++;
+    task->all_prev = NULL;
+    task->all_next = all_tasks;
+    if (all_tasks) {
+        all_tasks->all_prev = task;
+    }
+    all_tasks = task;
+    spin_unlock_irqrestore(&tasks_lock, flags);
+
+#ifdef __aarch64__
+    /*
+     * Same 272-byte frame as the EL1 IRQ entry (arch/aarch64/vectors.S):
+     *   x0-x30, ELR, SPSR, SP_EL0
+     * SP must stay 16-byte aligned, and the top of a kmalloc'd stack is
+     * only 8-byte aligned.
+     */
+    uint64_t* frame = (uint64_t*)(((uintptr_t)(task->stack + stack_size / 4)) & ~15ul);
+    frame -= FRAME64_WORDS;
+    for (uint32_t i = 0; i < FRAME64_WORDS; i++) {
+        frame[i] = 0;
+    }
+    frame[0] = (uintptr_t)func;                 // x0 - argument to task_wrapper
+    frame[FRAME64_ELR] = (uintptr_t)task_wrapper;
+    frame[FRAME64_SPSR] = PSR_MODE_EL1H;        // EL1h, IRQ enabled
+
+    task->stack_pointer = (uint32_t*)frame;
+#else
     /*
      * Stack layout for preemptive scheduler:
      * Must match IRQ handler's restore order:
@@ -66,9 +568,18 @@ int task_create(const char* name, TaskFunction func, uint32_t priority) {
      * So stack (from low to high address):
      *   SPSR, r0, r1, r2, r3, r4-r12, lr, pc
      */
-    uint32_t* sp = &task->stack[TASK_STACK_SIZE / 4];  // Start at top
-    
-    *(--sp) = (uint32_t)task_wrapper;  // pc
+    uint32_t* sp = task->stack + stack_size / 4;     // Start at top
+
+    // Exception return takes the state from the SPSR T bit, not from
+    // bit 0 of the PC, so a Thumb entry point needs both adjusted
+    uint32_t entry = (uint32_t)task_wrapper;
+    uint32_t spsr = PSR_MODE_SVC;       // SVC mode, IRQ enabled
+    if (entry & 1) {
+        spsr |= PSR_THUMB;
+        entry &= ~1u;
+    }
+
+    *(--sp) = entry;                    // pc
     *(--sp) = 0;                        // lr
     *(--sp) = 0;                        // r12
     *(--sp) = 0;                        // r11
@@ -83,159 +594,638 @@ int task_create(const char* name, TaskFunction func, uint32_t priority) {
     *(--sp) = 0;                        // r2
     *(--sp) = 0;                        // r1
     *(--sp) = (uint32_t)func;           // r0 - argument to task_wrapper
-    *(--sp) = 0x13;                     // SPSR - SVC mode, IRQ enabled
-    
+    *(--sp) = spsr;                     // SPSR
+
     task->stack_pointer = sp;
-    task->state = TASK_READY;
+#endif
     task->sleep_until = 0;
-    
-    uart_puts("Scheduler: Created task '");
-    uart_puts(name);
-    uart_puts("' (ID ");
-    uart_putc('0' + slot);
-    uart_puts(")\n");
-    
-    return slot;
-}
-
-static int find_next_task(void) {
-    if (current_task_index < 0) {
-        // No current task, find first ready
-        for (int i = 0; i < MAX_TASKS; i++) {
-            if (tasks[i].state == TASK_READY) {
-                return i;
+
+    // Publish on the owning core's run queue
+    RunQueue* rq = &runqueues[cpu];
+    flags = spin_lock_irqsave(&rq->lock);
+    if (policy == TASK_POLICY_IDLE) {
+        rq->idle = task;
+    } else {
+        rq->count++;
+        if (policy == TASK_POLICY_RT) {
+            rt_release(task, timer_ticks);      // First job released at once
+        } else {
+            task->vruntime = rq->min_vruntime;  // No credit for time before it existed
+        }
+        rq_enqueue(rq, task);
+        rq_kick(rq, cpu);
+    }
+    task->state = TASK_READY;
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    log_puts("Scheduler: Created task '");
+    log_puts(name);
+    log_puts("' (ID ");
+    log_putdec(task->id);
+    log_puts(", core ");
+    log_putdec(cpu);
+    log_puts(")\n");
+
+    return task->id;
+}
+
+int task_create_sized(const char* name, TaskFunction func, uint32_t priority,
+                      uint32_t cpu, uint32_t stack_size) {
+    return task_create_with(name, func, cpu, stack_size, TASK_POLICY_PRIO,
+                            priority > TASK_PRIO_MAX ? TASK_PRIO_MAX : (int)priority, NULL);
+}
+
+int task_create_fair(const char* name, TaskFunction func, int nice, uint32_t cpu) {
+    if (nice < TASK_NICE_MIN) {
+        nice = TASK_NICE_MIN;
+    } else if (nice > TASK_NICE_MAX) {
+        nice = TASK_NICE_MAX;
+    }
+    return task_create_with(name, func, cpu, TASK_STACK_SIZE, TASK_POLICY_FAIR, nice, NULL);
+}
+
+/*
+ * Body of every periodic task: one job per release. Jitter is the
+ * deviation of the start-to-start interval from the period; a job that
+ * ends past its deadline is a miss.
+ */
+static void periodic_main(void) {
+    Task* self = task_current();
+    TaskRt* rt = &self->rt;
+    uint32_t period_us = rt->period * TIMER_INTERVAL;
+
+    while (1) {
+        uint32_t start = *SYSTIMER_CLO;
+        if (rt->jobs) {
+            uint32_t interval = start - rt->last_start;
+            uint32_t jitter = interval > period_us ? interval - period_us : period_us - interval;
+            rt->jitter_sum += jitter;
+            if (jitter > rt->jitter_max) {
+                rt->jitter_max = jitter;
             }
         }
+        rt->last_start = start;
+        if (start - rt->release_us > rt->latency_max) {
+            rt->latency_max = start - rt->release_us;
+        }
+
+        rt->job();
+
+        RunQueue* rq = &runqueues[self->cpu];
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        uint32_t response = *SYSTIMER_CLO - rt->release_us;
+        rt->jobs++;
+        if (response > rt->response_max) {
+            rt->response_max = response;
+        }
+        if (response > rt->deadline * TIMER_INTERVAL) {
+            rt->misses++;
+        }
+        rt_await_release(rq, self);
+        spin_unlock_irqrestore(&rq->lock, flags);
+
+        // Returns early only before this core has its idle task
+        while (rt->awaiting) {
+            task_yield();
+        }
+    }
+}
+
+int task_create_periodic(const char* name, TaskFunction job, uint32_t period,
+                         uint32_t budget, uint32_t deadline) {
+    if (deadline == 0) {
+        deadline = period;
+    }
+    if (!job || period == 0 || period % TIMER_INTERVAL || deadline % TIMER_INTERVAL ||
+        deadline > period || budget == 0 || budget > deadline || budget > TASK_RT_BUDGET_MAX) {
+        uart_puts("Scheduler: bad periodic parameters for '");
+        uart_puts(name);
+        uart_puts("'\n");
+        return -1;
+    }
+
+    TaskRt rt = {
+        .job = job,
+        .period = period / TIMER_INTERVAL,
+        .deadline = deadline / TIMER_INTERVAL,
+        .budget = budget,
+        .density = budget * 1000 / deadline + (budget * 1000 % deadline != 0),
+    };
+
+    // Admit on the schedulable core with the most room, reserving it
+    // before the allocation so two creators cannot both take the room
+    int cpu = -1;
+    for (uint32_t c = 0; c < NUM_CORES; c++) {
+        if (cpu_schedulable(c) && runqueues[c].rt_density + rt.density <= TASK_RT_DENSITY_MAX &&
+            (cpu < 0 || runqueues[c].rt_density < runqueues[cpu].rt_density)) {
+            cpu = c;
+        }
+    }
+    if (cpu >= 0) {
+        RunQueue* rq = &runqueues[cpu];
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        if (rq->rt_density + rt.density <= TASK_RT_DENSITY_MAX) {
+            rq->rt_density += rt.density;
+        } else {
+            cpu = -1;
+        }
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+    if (cpu < 0) {
+        uart_puts("Scheduler: '");
+        uart_puts(name);
+        uart_puts("' rejected, no core has ");
+        uart_putdec(rt.density);
+        uart_puts("/1000 of real-time capacity left\n");
         return -1;
     }
-    
-    int start = (current_task_index + 1) % MAX_TASKS;
-    int idx = start;
-    
-    do {
-        // Check for sleeping tasks that should wake up
-        if (tasks[idx].state == TASK_SLEEPING) {
-            if (timer_ticks >= tasks[idx].sleep_until) {
-                tasks[idx].state = TASK_READY;
-            }
+
+    int id = task_create_with(name, periodic_main, cpu, TASK_STACK_SIZE, TASK_POLICY_RT, 0, &rt);
+    if (id < 0) {
+        RunQueue* rq = &runqueues[cpu];
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        rq->rt_density -= rt.density;
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+    return id;
+}
+
+/*
+ * Caller holds rq->lock. Takes the next task off the ready lists; a
+ * still-running prev goes back first, behind its peers and any sleeper
+ * that just woke, so it is picked again only if nothing outranks it.
+ * Order: periodic (EDF), priority 1 and up, the fair heap, priority 0,
+ * then the idle task (NULL before the core has one).
+ */
+static HOT Task* pick_next_task(RunQueue* rq, Task* prev) {
+    sched_account(rq, prev);
+    timers_expire(rq);
+
+    // Budget enforcement: an overrunning job waits for its next release
+    if (prev && prev->policy == TASK_POLICY_RT && prev->state == TASK_RUNNING &&
+        prev->rt.used > prev->rt.budget) {
+        prev->rt.overruns++;
+        prev->rt.misses++;
+        rt_await_release(rq, prev);
+    }
+
+    if (prev && prev->state == TASK_RUNNING) {
+        prev->state = TASK_READY;
+        rq_enqueue(rq, prev);
+    }
+    if (rq->rt_root) {
+        Task* next = heap_pop(&rq->rt_root);
+        next->rt.since = *SYSTIMER_CLO;
+        return next;
+    }
+    if (rq->ready_mask > 1) {
+        return rq_pop(rq, rq_top(rq->ready_mask));
+    }
+    if (rq->fair_root) {
+        Task* next = heap_pop(&rq->fair_root);
+        if (next->vruntime > rq->min_vruntime) {
+            rq->min_vruntime = next->vruntime;
+        }
+        return next;
+    }
+    if (rq->ready_mask) {
+        return rq_pop(rq, 0);
+    }
+    return rq->idle;
+}
+
+/*
+ * Caller holds rq->lock. Zombies were queued by an earlier switch on
+ * this core, so nothing is running on their stacks any more.
+ */
+static void reap_zombies(RunQueue* rq) {
+    while (rq->zombies) {
+        Task* task = rq->zombies;
+        rq->zombies = task->next;
+
+        uint32_t flags = spin_lock_irqsave(&tasks_lock);
+        if (task->all_prev) {
+            task->all_prev->all_next = task->all_next;
+        } else {
+            all_tasks = task->all_next;
+        }
+        if (task->all_next) {
+            task->all_next->all_prev = task->all_prev;
         }
-        
-        if (tasks[idx].state == TASK_READY) {
-            return idx;
+        spin_unlock_irqrestore(&tasks_lock, flags);
+
+        fpu_release(task);
+        stack_free(task->stack);
+        kmem_cache_free(task_cache, task);
+    }
+}
+
+// Caller holds rq->lock
+static HOT void switch_to_locked(RunQueue* rq, Task* prev, Task* next) {
+    reap_zombies(rq);
+
+    if (prev && prev->state == TASK_TERMINATED) {
+        // Freed once we are off its stack, at the next switch
+        prev->next = rq->zombies;
+        rq->zombies = prev;
+    }
+
+    next->state = TASK_RUNNING;
+    rq->current = next;
+    current_sp_ptr[next->cpu] = &next->stack_pointer;
+    fpu_switch(next);
+}
+
+// Dry run of the scheduler's pick, no switch and no sleeper wakeup
+// (used by bench). Lock-free on purpose: bench may run it with the
+// D-cache off.
+Task* scheduler_peek_next(void) {
+    RunQueue* rq = &runqueues[cpu_id()];
+    Task* cur = rq->current;
+    uint32_t mask = rq->ready_mask;
+
+    if (cur && cur->state != TASK_RUNNING) {
+        cur = NULL;
+    }
+    if (rq->rt_root || (cur && cur->policy == TASK_POLICY_RT)) {
+        if (!cur || cur->policy != TASK_POLICY_RT) {
+            return rq->rt_root;
         }
-        idx = (idx + 1) % MAX_TASKS;
-    } while (idx != start);
-    
-    return -1;
+        return (rq->rt_root && heap_before(rq->rt_root, cur)) ? rq->rt_root : cur;
+    }
+    if (cur && cur->policy == TASK_POLICY_PRIO && cur->priority > 0) {
+        return (mask && rq_top(mask) >= cur->priority) ? rq->ready[rq_top(mask)].head : cur;
+    }
+    if (mask > 1) {
+        return rq->ready[rq_top(mask)].head;
+    }
+    if (cur && cur->policy == TASK_POLICY_FAIR) {
+        return (rq->fair_root && rq->fair_root->vruntime < cur->vruntime) ? rq->fair_root : cur;
+    }
+    if (rq->fair_root) {
+        return rq->fair_root;
+    }
+    if (mask) {
+        return rq->ready[0].head;
+    }
+    return cur ? cur : rq->idle;
+}
+
+HOT void scheduler_irq_entry(uint32_t core) {
+    SwitchClock* clock = &switch_clock[core];
+
+    if (clock->enabled) {
+        clock->entry = cycles();
+    }
+}
+
+void switch_timing_start(void) {
+    SwitchClock* clock = &switch_clock[cpu_id()];
+
+    uint32_t flags = irq_save();
+    clock->stats.switches = 0;
+    clock->stats.total = 0;
+    clock->stats.max = 0;
+    clock->enabled = 1;
+    irq_restore(flags);
+}
+
+void switch_timing_stop(SwitchTiming* out) {
+    SwitchClock* clock = &switch_clock[cpu_id()];
+
+    uint32_t flags = irq_save();
+    clock->enabled = 0;
+    *out = clock->stats;
+    irq_restore(flags);
 }
 
 // Called from IRQ handler - preemptive scheduling
-uint32_t* preempt_schedule(uint32_t* current_sp) {
-    if (!scheduler_running) {
+HOT uint32_t* preempt_schedule(uint32_t* current_sp) {
+    uint32_t core = cpu_id();
+    RunQueue* rq = &runqueues[core];
+
+    if (!rq->running) {
         return 0;  // Return 0 means no switch
     }
-    
+
+    // IRQs are already masked here
+    spin_lock(&rq->lock);
+
     // Save current task's SP
-    if (current_task_index >= 0) {
-        tasks[current_task_index].stack_pointer = current_sp;
+    Task* prev = rq->current;
+    if (prev) {
+        prev->stack_pointer = current_sp;
+        stack_check(rq, prev);
     }
-    
+
     // Find next task
-    int next = find_next_task();
-    
-    if (next < 0) {
-        return 0;  // No task to switch to
-    }
-    
-    if (next == current_task_index) {
-        return 0;  // Same task, no switch needed
+    Task* next = pick_next_task(rq, prev);
+
+    if (!next || next == prev) {
+        if (next) {
+            next->state = TASK_RUNNING;
+        }
+        spin_unlock(&rq->lock);
+        return 0;  // No task to switch to / same task
     }
-    
+
     // Perform switch
-    int prev = current_task_index;
-    current_task_index = next;
-    
-    if (prev >= 0 && tasks[prev].state == TASK_RUNNING) {
-        tasks[prev].state = TASK_READY;
+    switch_to_locked(rq, prev, next);
+    spin_unlock(&rq->lock);
+
+    SwitchClock* clock = &switch_clock[core];
+    if (clock->enabled) {
+        uint32_t took = cycles() - clock->entry;
+        clock->stats.switches++;
+        clock->stats.total += took;
+        if (took > clock->stats.max) {
+            clock->stats.max = took;
+        }
     }
-    
-    tasks[next].state = TASK_RUNNING;
-    current_sp_ptr = &tasks[next].stack_pointer;
-    
-    return tasks[next].stack_pointer;  // Return new SP
+
+    return next->stack_pointer;  // Return new SP
 }
 
 // Called from user code - cooperative scheduling
-void schedule(void) {
-    if (!scheduler_running) {
+HOT void schedule(void) {
+    RunQueue* rq = &runqueues[cpu_id()];
+
+    if (!rq->running) {
         return;
     }
-    
-    int next = find_next_task();
-    
-    if (next < 0 || next == current_task_index) {
+
+    // IRQs stay masked until we are back on this task's stack
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+
+    Task* prev = rq->current;
+    if (prev) {
+        stack_check(rq, prev);
+    }
+    Task* next = pick_next_task(rq, prev);
+
+    if (!next || next == prev) {
+        if (next) {
+            next->state = TASK_RUNNING;
+        }
+        spin_unlock_irqrestore(&rq->lock, flags);
         return;
     }
-    
-    int prev = current_task_index;
-    current_task_index = next;
-    
-    if (prev >= 0 && tasks[prev].state == TASK_RUNNING) {
-        tasks[prev].state = TASK_READY;
-    }
-    
-    tasks[next].state = TASK_RUNNING;
-    current_sp_ptr = &tasks[next].stack_pointer;
-    
-    if (prev >= 0) {
-        context_switch(&tasks[prev].stack_pointer, tasks[next].stack_pointer);
+
+    switch_to_locked(rq, prev, next);
+    spin_unlock(&rq->lock);
+
+    if (prev) {
+        context_switch(&prev->stack_pointer, next->stack_pointer);
     } else {
-        context_switch(0, tasks[next].stack_pointer);
+        context_switch(0, next->stack_pointer);
+    }
+
+    irq_restore(flags);
+}
+
+/*
+ * Idle task body. WFI runs with IRQs masked so the time asleep is
+ * counted before the handler (and maybe a switch) runs; a pending IRQ
+ * still ends it. Tickless, the only timer interrupt is the one for the
+ * earliest sleeper, and ticks missed meanwhile are caught up on wake.
+ */
+static void idle_main(void) {
+    uint32_t core = cpu_id();
+    RunQueue* rq = &runqueues[core];
+
+    while (1) {
+        disable_irq();
+        spin_lock(&rq->lock);
+        int work = rq->ready_mask || rq->rt_root || rq->fair_root;
+        int quiet = tickless && !work;
+        uint32_t wake = *SYSTIMER_CLO + TIMER_IDLE_MAX_US;
+        uint32_t tick;
+        if (quiet && wheel_next(&rq->wheel, &tick)) {
+            wake = tick_time_us(tick);
+        }
+        spin_unlock(&rq->lock);
+
+        if (work) {
+            enable_irq();
+            schedule();
+            continue;
+        }
+
+        if (quiet) {
+            timer_idle_program(wake);
+        }
+        uint32_t start = *SYSTIMER_CLO;
+        __asm__ __volatile__("dsb sy\n\twfi" ::: "memory");
+        idle_time[core] += *SYSTIMER_CLO - start;
+        if (quiet) {
+            ticks_sync();
+            timer_idle_restore();
+        }
+        enable_irq();
     }
 }
 
+/*
+ * Deferred context for callback timers, one per core at the top
+ * priority: callbacks run here with IRQs on, never in the tick IRQ.
+ */
+static void timer_task_main(void) {
+    RunQueue* rq = &runqueues[cpu_id()];
+    Task* self = task_current();
+
+    while (1) {
+        TimerCallback func = NULL;
+        void* arg = NULL;
+
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        rq->timer_task = self;
+        rq->timer_running = NULL;
+        Timer* t = rq->timers_due;
+        if (t) {
+            // The callback may re-add or free its timer
+            timer_list_unlink(t);
+            func = t->func;
+            arg = t->arg;
+            rq->timer_running = t;
+        } else {
+            self->state = TASK_BLOCKED;
+        }
+        spin_unlock_irqrestore(&rq->lock, flags);
+
+        if (func) {
+            func(arg);
+        } else {
+            schedule();
+        }
+    }
+}
+
+// Per-core tasks the scheduler itself needs
+static void core_tasks_create(uint32_t core) {
+    task_create_with("idle", idle_main, core, IDLE_STACK_SIZE, TASK_POLICY_IDLE, 0, NULL);
+    task_create_on("timers", timer_task_main, TASK_PRIO_MAX, core);
+}
+
+void timer_add(Timer* timer, TimerCallback func, void* arg, uint32_t ticks) {
+    if (!func) {
+        return;
+    }
+    timer_cancel(timer);
+
+    uint32_t core = cpu_id();
+    RunQueue* rq = &runqueues[core];
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    timer->func = func;
+    timer->arg = arg;
+    timer->cpu = core;
+    timer->expires = timer_ticks + (ticks ? ticks : 1);
+    wheel_add(&rq->wheel, timer);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Caller holds rq->lock
+static int timer_unqueue(RunQueue* rq, Timer* timer) {
+    int queued = timer_queued(timer);
+    if (queued && timer->slot == WHEEL_NONE) {
+        timer_list_unlink(timer);       // Expired, callback not run yet
+    } else if (queued) {
+        wheel_del(&rq->wheel, timer);
+    }
+    return queued;
+}
+
+int timer_cancel(Timer* timer) {
+    RunQueue* rq = &runqueues[timer->cpu];
+
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    int queued = timer_unqueue(rq, timer);
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return queued;
+}
+
+int timer_cancel_sync(Timer* timer) {
+    RunQueue* rq = &runqueues[timer->cpu];
+
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        int queued = timer_unqueue(rq, timer);
+        int running = rq->timer_running == timer;
+        spin_unlock_irqrestore(&rq->lock, flags);
+        if (!running) {
+            return queued;
+        }
+        // The timers task is top priority on its core: let it finish
+        task_yield();
+    }
+}
+
+void scheduler_set_tickless(int on) {
+    tickless = on;
+
+    // Idle cores pick the mode up on their next pass through the loop
+    for (uint32_t c = 0; c < NUM_CORES; c++) {
+        RunQueue* rq = &runqueues[c];
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        rq_kick(rq, c);
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+}
+
+int scheduler_tickless(void) {
+    return tickless;
+}
+
+uint32_t scheduler_idle_us(uint32_t core) {
+    return idle_time[core];
+}
+
 void scheduler_start(void) {
-    uart_puts("Scheduler: Starting...\n");
-    
-    current_task_index = find_next_task();
-    
-    if (current_task_index < 0) {
+    log_puts("Scheduler: Starting...\n");
+    core_tasks_create(cpu_id());
+
+    // The first task's SPSR turns IRQs back on
+    disable_irq();
+    cycles_enable();                    // Clock for runtime accounting
+
+    RunQueue* rq = &runqueues[cpu_id()];
+
+    spin_lock(&rq->lock);
+    Task* first = pick_next_task(rq, NULL);
+
+    if (!first) {
+        spin_unlock(&rq->lock);
         uart_puts("Scheduler: No tasks to run!\n");
+        enable_irq();
         return;
     }
-    
+
+    switch_to_locked(rq, NULL, first);
+    rq->running = 1;
+    spin_unlock(&rq->lock);
+
+    // Release cores 1-3 waiting in scheduler_start_secondary()
     scheduler_running = 1;
-    tasks[current_task_index].state = TASK_RUNNING;
-    current_sp_ptr = &tasks[current_task_index].stack_pointer;
-    
-    uart_puts("Scheduler: Running task '");
-    uart_puts(tasks[current_task_index].name);
-    uart_puts("'\n\n");
-    
+    __asm__ __volatile__("dsb sy\n\tsev" ::: "memory");
+
+    log_puts("Scheduler: Running task '");
+    log_puts(first->name);
+    log_puts("'\n\n");
+
     // Jump to first task
-    context_switch(0, tasks[current_task_index].stack_pointer);
-    
+    context_switch(0, first->stack_pointer);
+
     uart_puts("Scheduler: ERROR - scheduler_start returned!\n");
     while(1);
 }
 
+/*
+ * Cores 1-3: wait for core 0 to start scheduling, then wait in the
+ * boot context. The first tick switches to a ready task or this core's
+ * idle task, and the boot context is never resumed.
+ */
+void scheduler_start_secondary(void) {
+    while (!scheduler_running) {
+        __asm__ __volatile__("wfe");
+    }
+
+    RunQueue* rq = &runqueues[cpu_id()];
+    core_tasks_create(cpu_id());
+    cycles_enable();
+    rq->running = 1;
+
+    enable_irq();
+    while (1) {
+        __asm__ __volatile__("wfi");
+    }
+}
+
 void scheduler_tick(void) {
     // For preemptive: do nothing here, scheduling happens in IRQ handler
 }
 
 void task_exit(void) {
-    if (current_task_index < 0) {
+    RunQueue* rq = &runqueues[cpu_id()];
+    Task* task = rq->current;
+
+    if (!task) {
         return;
     }
-    
-    uart_puts("\nTask '");
-    uart_puts(tasks[current_task_index].name);
-    uart_puts("' exited.\n");
-    
-    tasks[current_task_index].state = TASK_TERMINATED;
-    
+
+    log_puts("\nTask '");
+    log_puts(task->name);
+    log_puts("' exited.\n");
+
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    sleep_cancel(rq, task);
+    task->state = TASK_TERMINATED;
+    rq->count--;
+    if (task->policy == TASK_POLICY_RT) {
+        rq->rt_density -= task->rt.density;
+    }
+    spin_unlock_irqrestore(&rq->lock, flags);
+
     schedule();
-    
+
     uart_puts("Scheduler: All tasks terminated.\n");
     while (1) {
         __asm__ __volatile__("wfi");
@@ -247,68 +1237,259 @@ void task_yield(void) {
 }
 
 void task_sleep(uint32_t ticks) {
-    if (current_task_index < 0) return;
-    
-    tasks[current_task_index].sleep_until = timer_ticks + ticks;
-    tasks[current_task_index].state = TASK_SLEEPING;
-    
+    RunQueue* rq = &runqueues[cpu_id()];
+    Task* task = rq->current;
+
+    if (!task) return;
+
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    sleep_cancel(rq, task);
+    task->sleep_until = timer_ticks + ticks;
+    task->state = TASK_SLEEPING;
+    sleep_arm(rq, task);
+    spin_unlock_irqrestore(&rq->lock, flags);
+
     schedule();
 }
 
-Task* task_current(void) {
-    if (current_task_index >= 0) {
-        return &tasks[current_task_index];
+/*
+ * Block until *cond becomes non-zero. The waker sets *cond first and
+ * then calls task_wake(); checking under the run queue lock means a
+ * wake between the check and the switch is never lost.
+ */
+void task_wait(volatile int* cond) {
+    RunQueue* rq = &runqueues[cpu_id()];
+    Task* task = rq->current;
+
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&rq->lock);
+        if (task) sleep_cancel(rq, task);
+        if (*cond) {
+            if (task) task->state = TASK_RUNNING;
+            spin_unlock_irqrestore(&rq->lock, flags);
+            return;
+        }
+        if (task) task->state = TASK_BLOCKED;
+        spin_unlock_irqrestore(&rq->lock, flags);
+
+        schedule();
+    }
+}
+
+// Safe from any core and from IRQ context
+void task_wake(Task* task) {
+    RunQueue* rq = &runqueues[task->cpu];
+
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    if (task->state == TASK_BLOCKED) {
+        if (rq->current == task) {
+            task->state = TASK_RUNNING;
+        } else {
+            rq_wake(rq, task);
+            rq_kick(rq, task->cpu);
+        }
     }
-    return 0;
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+int scheduler_is_running(void) {
+    return runqueues[cpu_id()].running;
+}
+
+Task* task_current(void) {
+    return runqueues[cpu_id()].current;
 }
 
 int task_count(void) {
     int count = 0;
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state != TASK_UNUSED && 
-            tasks[i].state != TASK_TERMINATED) {
-            count++;
-        }
+    for (int c = 0; c < NUM_CORES; c++) {
+        count += runqueues[c].count;
     }
     return count;
 }
 
+// Copy of one task for printing, taken under tasks_lock
+typedef struct {
+    uint32_t id;
+    uint32_t cpu;
+    uint32_t priority;
+    uint32_t policy;
+    int nice;
+    uint32_t stack_size;
+    uint32_t stack_peak;
+    uint32_t overflowed;
+    TaskState state;
+    char name[TASK_NAME_LEN];
+    TaskRt rt;
+} TaskSnapshot;
+
+// Task with the lowest id >= min_id; 0 if there is none
+static int task_snapshot_from(uint32_t min_id, TaskSnapshot* snap) {
+    Task* best = NULL;
+
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    for (Task* t = all_tasks; t; t = t->all_next) {
+        if (t->id >= min_id && (!best || t->id < best->id)) {
+            best = t;
+        }
+    }
+    if (best) {
+        snap->id = best->id;
+        snap->cpu = best->cpu;
+        snap->priority = best->priority;
+        snap->policy = best->policy;
+        snap->nice = best->nice;
+        snap->stack_size = best->stack_size;
+        snap->stack_peak = task_stack_peak(best);
+        snap->overflowed = best->overflowed;
+        snap->state = best->state;
+        str_copy(snap->name, best->name, TASK_NAME_LEN);
+        snap->rt = best->rt;
+    }
+    spin_unlock_irqrestore(&tasks_lock, flags);
+
+    return best != NULL;
+}
+
 void task_list(void) {
+    TaskSnapshot snap;
+
     uart_puts("\n");
-    uart_puts("  ID  Name            State\n");
-    uart_puts("  --  ----            -----\n");
-    
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_UNUSED) continue;
-        
+    uart_puts("  ID  Name            Core  Prio  Stack   Peak  State\n");
+    uart_puts("  --  ----            ----  ----  -----   ----  -----\n");
+
+    // One task per lock hold, so printing never runs with IRQs masked
+    for (uint32_t id = 0; task_snapshot_from(id, &snap); id = snap.id + 1) {
         uart_puts("  ");
-        uart_putc('0' + i);
-        uart_puts("   ");
-        
-        uart_puts(tasks[i].name);
+        uart_putdec(snap.id);
+        uart_puts(snap.id < 10 ? "   " : snap.id < 100 ? "  " : " ");
+
+        uart_puts(snap.name);
         int len = 0;
-        const char* p = tasks[i].name;
+        const char* p = snap.name;
         while (*p++) len++;
         int pad = 16 - len;
         while (pad-- > 0) uart_putc(' ');
-        
-        switch (tasks[i].state) {
+
+        uart_putdec(snap.cpu);
+        uart_puts("     ");
+
+        // Fair tasks show their nice value instead, as n0, n-5, n19
+        if (snap.policy == TASK_POLICY_FAIR) {
+            uart_putc('n');
+            if (snap.nice < 0) {
+                uart_putc('-');
+            }
+            uint32_t mag = snap.nice < 0 ? -snap.nice : snap.nice;
+            uart_putdec(mag);
+            pad = 5 - (snap.nice < 0) - (mag < 10 ? 1 : 2);
+        } else if (snap.policy == TASK_POLICY_RT) {
+            uart_puts("rt");
+            pad = 4;
+        } else if (snap.policy == TASK_POLICY_IDLE) {
+            uart_puts("-");
+            pad = 5;
+        } else {
+            uart_putdec(snap.priority);
+            pad = snap.priority < 10 ? 5 : 4;
+        }
+        while (pad-- > 0) uart_putc(' ');
+
+        uart_putdec(snap.stack_size);
+        pad = snap.stack_size < 1000 ? 2 : snap.stack_size < 10000 ? 1 : 0;
+        while (pad-- > 0) uart_putc(' ');
+
+        pad = snap.stack_peak < 10 ? 6 : snap.stack_peak < 100 ? 5 :
+              snap.stack_peak < 1000 ? 4 : snap.stack_peak < 10000 ? 3 : 2;
+        while (pad-- > 0) uart_putc(' ');
+        uart_putdec(snap.stack_peak);
+        uart_puts("  ");
+
+        if (snap.overflowed) {
+            uart_puts("OVERFLOW\n");
+            continue;
+        }
+
+        switch (snap.state) {
             case TASK_READY:      uart_puts("Ready"); break;
             case TASK_RUNNING:    uart_puts("Running *"); break;
             case TASK_BLOCKED:    uart_puts("Blocked"); break;
             case TASK_SLEEPING:   uart_puts("Sleeping"); break;
             case TASK_TERMINATED: uart_puts("Terminated"); break;
+            case TASK_PARKED:     uart_puts("Parked"); break;
             default:              uart_puts("Unknown"); break;
         }
-        
+
         uart_puts("\n");
     }
-    uart_puts("\n");
+
+    uart_puts("\n  Cores online: ");
+    uart_puthex(smp_online_mask());
+    uart_puts(", lazy FPU switches: ");
+    uart_putdec(fpu_trap_count());
+    uart_puts("\n\n");
 }
 
-Task* get_current_task(void) {
-    if (current_task_index >= 0) {
-        return &tasks[current_task_index];
+static void print_col(uint32_t val, int width) {
+    uint32_t tmp = val;
+    int digits = 1;
+    while (tmp >= 10) {
+        tmp /= 10;
+        digits++;
     }
-    return NULL;
-}
\ No newline at end of file
+    while (digits++ < width) uart_putc(' ');
+    uart_putdec(val);
+}
+
+void task_rt_list(void) {
+    TaskSnapshot snap;
+    uint32_t shown = 0;
+
+    uart_puts("\n  Periodic tasks, us (period and deadline in ticks of ");
+    uart_putdec(TIMER_INTERVAL);
+    uart_puts(" us)\n");
+    uart_puts("  ID  Name        Core Period Dline  Budget    Jobs  Miss  Over"
+              "  Jit avg  Jit max  Lat max Resp max\n");
+
+    for (uint32_t id = 0; task_snapshot_from(id, &snap); id = snap.id + 1) {
+        if (snap.policy != TASK_POLICY_RT) {
+            continue;
+        }
+        const TaskRt* rt = &snap.rt;
+
+        print_col(snap.id, 4);
+        uart_puts("  ");
+        uart_puts(snap.name);
+        int pad = 12;
+        for (const char* p = snap.name; *p; p++) pad--;
+        while (pad-- > 0) uart_putc(' ');
+        print_col(snap.cpu, 4);
+        print_col(rt->period, 7);
+        print_col(rt->deadline, 6);
+        print_col(rt->budget, 8);
+        print_col(rt->jobs, 8);
+        print_col(rt->misses, 6);
+        print_col(rt->overruns, 6);
+        print_col(rt->jobs > 1 ? rt->jitter_sum / (rt->jobs - 1) : 0, 9);
+        print_col(rt->jitter_max, 9);
+        print_col(rt->latency_max, 9);
+        print_col(rt->response_max, 9);
+        uart_puts("\n");
+        shown++;
+    }
+
+    uart_puts("  ");
+    uart_putdec(shown);
+    uart_puts(" periodic; density reserved per core (of ");
+    uart_putdec(TASK_RT_DENSITY_MAX);
+    uart_puts("/1000):");
+    for (uint32_t c = 0; c < NUM_CORES; c++) {
+        uart_puts(" ");
+        uart_putdec(runqueues[c].rt_density);
+    }
+    uart_puts("\n\n");
+}
+
+Task* get_current_task(void) {
+    return task_current();
+}
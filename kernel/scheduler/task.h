@@ -2,34 +2,130 @@
 #define TASK_H
 
 #include <stdint.h>
+#include "timer_wheel.h"
 
-#define MAX_TASKS       8
-#define TASK_STACK_SIZE 4096
+#define TASK_STACK_SIZE CONFIG_TASK_STACK_SIZE  // Default for task_create / task_create_on
+#define TASK_STACK_MIN  512     // Initial frame plus a few calls
+
+// Unused stack is filled with STACK_PAINT to measure peak usage; the
+// lowest words hold STACK_CANARY and are checked on every switch away.
+#define STACK_PAINT         0xA5A5A5A5
+#define STACK_CANARY        0xC0DEFACE
+#define STACK_CANARY_WORDS  4
 #define TASK_NAME_LEN   32
 
+// Let task_create pick the least loaded online core
+#define TASK_CPU_ANY    0xFFFFFFFF
+
+// Priorities 0 (lowest) to TASK_PRIO_MAX; the highest ready level runs,
+// tasks of equal priority share it round-robin. Larger values are clamped.
+#define TASK_PRIO_LEVELS    32      // One bit each in the ready mask
+#define TASK_PRIO_MAX       (TASK_PRIO_LEVELS - 1)
+
+/*
+ * Fair-share tasks (task_create_fair) have no priority: they split the
+ * CPU by weight, least virtual runtime first. As a class they run when
+ * no task of priority 1 or above is ready, ahead of priority 0.
+ *
+ * Periodic tasks (task_create_periodic) outrank both: earliest deadline
+ * first, each job limited to its budget.
+ *
+ * Each core also has an idle task, on no queue, that runs when nothing
+ * else can and waits in WFI.
+ */
+#define TASK_NICE_MIN       (-20)   // Weight 88761, ~87x nice 0
+#define TASK_NICE_MAX       19      // Weight 15
+#define TASK_WEIGHT_NICE_0  1024
+
+typedef enum {
+    TASK_POLICY_PRIO = 0,
+    TASK_POLICY_FAIR,
+    TASK_POLICY_RT,
+    TASK_POLICY_IDLE
+} TaskPolicy;
+
+// Admission: the budget/deadline densities on one core may not exceed
+// this per-mille, so EDF meets every deadline and normal tasks keep 10%
+#define TASK_RT_DENSITY_MAX 900
+#define TASK_RT_BUDGET_MAX  4000000     // us; keeps the density maths in 32 bits
+
 typedef enum {
     TASK_UNUSED = 0,
     TASK_READY,
     TASK_RUNNING,
     TASK_BLOCKED,
     TASK_SLEEPING,
-    TASK_TERMINATED
+    TASK_TERMINATED,
+    TASK_PARKED             // Stack overflowed; never runs or wakes again
 } TaskState;
 
 typedef void (*TaskFunction)(void);
 
+// Periodic task parameters and counters. Times are us except where
+// noted; releases fall on ticks.
 typedef struct {
-    uint32_t id;
-    char name[TASK_NAME_LEN];
-    TaskState state;
+    TaskFunction job;       // Called once per release
+    uint32_t period;        // Ticks
+    uint32_t deadline;      // Ticks after the release
+    uint32_t budget;        // Per job
+    uint32_t density;       // Per-mille of the core reserved at admission
+    uint32_t release;       // Tick of the current job's release
+    uint32_t release_us;    // SYSTIMER_CLO when it was released
+    uint32_t used;          // Budget spent by the current job
+    uint32_t since;         // SYSTIMER_CLO when it last got the CPU
+    uint32_t awaiting;      // Parked until the next release
+    uint32_t last_start;
+    uint32_t jobs;
+    uint32_t misses;        // Finished late, throttled, or release skipped
+    uint32_t overruns;      // Throttled for exceeding the budget
+    uint32_t jitter_sum;    // |start-to-start interval - period|
+    uint32_t jitter_max;
+    uint32_t latency_max;   // Release to job start
+    uint32_t response_max;  // Release to job completion
+} TaskRt;
+
+struct FpuContext;
+
+/*
+ * Allocated from a cache-line-aligned slab cache. Everything the
+ * scheduler reads per tick sits in the first 64 bytes; the stack is a
+ * separate heap block, so a pick touches one line per task it moves.
+ */
+typedef struct Task {
+    // Hot: scheduling decisions and context switch
     uint32_t* stack_pointer;
-    uint32_t stack[TASK_STACK_SIZE / 4];
+    TaskState state;
     uint32_t priority;
     uint32_t sleep_until;
+    uint32_t cpu;           // Core whose run queue owns this task
+    struct Task* next;      // Ready or zombie list of its core
+    union {
+        uint64_t vruntime;  // Fair class: cycles run, scaled by weight
+        uint32_t deadline;  // RT class: tick the current job is due
+    };
+    struct Task* heap_left; // Fair and RT classes: leftist heap of ready tasks
+    struct Task* heap_right;
+    uint32_t fair_inv;      // TASK_WEIGHT_NICE_0 / weight, 16.16
+    uint8_t heap_rank;      // Right spine length below this node
+    uint8_t policy;         // TaskPolicy
+    int8_t nice;
+
+    // Cold: creation, ps, teardown
+    uint64_t runtime;       // Cycles on the CPU, every policy
+    uint32_t id;
+    uint32_t* stack;        // Lowest usable address (canaries live here)
+    uint32_t stack_size;
+    uint32_t overflowed;    // Canary found broken; task is parked
+    struct FpuContext* fpu; // Saved VFP/NEON state, allocated on first use
+    struct Task* all_next;  // Every live task, for ps
+    struct Task* all_prev;
+    char name[TASK_NAME_LEN];
+    Timer sleep_timer;      // Sleeps and periodic releases, on its core's wheel
+    TaskRt rt;              // TASK_POLICY_RT only
 } Task;
 
-// Pointer to current task's SP storage (used by IRQ handler)
-extern uint32_t** current_sp_ptr;
+// Per-core pointer to current task's SP storage (used by IRQ handler)
+extern uint32_t** current_sp_ptr[];
 
 // Assembly function
 extern void context_switch(uint32_t** old_sp, uint32_t* new_sp);
@@ -37,18 +133,80 @@ extern void context_switch(uint32_t** old_sp, uint32_t* new_sp);
 // Scheduler functions
 void scheduler_init(void);
 void scheduler_start(void);
+void scheduler_start_secondary(void);
 void scheduler_tick(void);
+int scheduler_is_running(void);
+
+// Returns the task this core would switch to next, or NULL
+Task* scheduler_peek_next(void);
 
 // Preemptive scheduler function (called from IRQ)
 uint32_t* preempt_schedule(uint32_t* current_sp);
 
+// IRQ-to-switch cost on the calling core, in cycles: from irq_handler_c
+// entry until preempt_schedule has picked a different task
+typedef struct {
+    uint32_t switches;
+    uint32_t total;
+    uint32_t max;
+} SwitchTiming;
+
+void scheduler_irq_entry(uint32_t core);    // Called first by irq_handler_c
+void switch_timing_start(void);             // Needs cycles_enable() on this core
+void switch_timing_stop(SwitchTiming* out);
+
+// Tickless idle: the idle task programs the timer for the earliest
+// timer on its wheel instead of taking every tick. Default from CONFIG_TICKLESS.
+void scheduler_set_tickless(int on);
+int scheduler_tickless(void);
+
+// Time the core spent in the idle task's WFI, us (wraps)
+uint32_t scheduler_idle_us(uint32_t core);
+
 // Task functions
 int task_create(const char* name, TaskFunction func, uint32_t priority);
+int task_create_on(const char* name, TaskFunction func, uint32_t priority, uint32_t cpu);
+int task_create_sized(const char* name, TaskFunction func, uint32_t priority,
+                      uint32_t cpu, uint32_t stack_size);
+int task_create_fair(const char* name, TaskFunction func, int nice, uint32_t cpu);
+uint32_t task_nice_weight(int nice);
+
+// Calls job once per period (us, a multiple of TIMER_INTERVAL) on the
+// core with the most spare density; deadline 0 means the period. -1 if
+// the parameters are bad or admission fails.
+int task_create_periodic(const char* name, TaskFunction job, uint32_t period,
+                         uint32_t budget, uint32_t deadline);
+void task_rt_list(void);
 void task_exit(void);
 void task_yield(void);
 void task_sleep(uint32_t ticks);
 void task_list(void);
 
+/*
+ * Callback timers: func(arg) runs `ticks` ticks from now (at least one)
+ * in the calling core's "timers" task, not in the tick IRQ. The Timer
+ * must start zeroed and stay valid until it fires or is cancelled;
+ * adding a pending timer re-arms it. The core must run the scheduler.
+ */
+void timer_add(Timer* timer, TimerCallback func, void* arg, uint32_t ticks);
+// 1 if it was still pending; 0 if it has fired (or is firing) or was never added
+int timer_cancel(Timer* timer);
+// As timer_cancel, but a callback already running has returned by the
+// time this does, so the Timer and arg may then be reused or freed.
+// From a task, not from the timer's own callback.
+int timer_cancel_sync(Timer* timer);
+
+// Blocking: sleep until *cond != 0; waker sets *cond then calls task_wake
+void task_wait(volatile int* cond);
+void task_wake(Task* task);
+
+// Peak stack bytes used so far, from the painted pattern
+uint32_t task_stack_peak(const Task* task);
+
+// Name of the task whose guard page holds addr, or NULL (always NULL
+// without STACK_GUARD). Lock-free: meant for fault reporting only.
+const char* task_guard_owner(uint32_t addr);
+
 // Task info
 Task* task_current(void);
 Task* get_current_task(void);
@@ -0,0 +1,166 @@
+/*
+ * timer_wheel.c - Hierarchical hashed timer wheel
+ *
+ * w->next is the next tick to process. A timer due d = expires - next
+ * ticks from it goes on level L, the lowest with d < WHEEL_SLOTS^(L+1),
+ * in slot (expires >> L * WHEEL_BITS) % WHEEL_SLOTS. When the wheel
+ * reaches the start of a level-L slot's span it cascades that slot: its
+ * timers are due within the span and are re-added one level down or
+ * lower. Level 0 then holds exactly the timers due at each tick.
+ */
+
+#include "timer_wheel.h"
+#include "../hot.h"
+
+#define SLOT_MASK   (WHEEL_SLOTS - 1)
+
+static inline uint32_t level_shift(uint32_t level) {
+    return level * WHEEL_BITS;
+}
+
+// Rotate right so bit 0 is slot `by`
+static inline uint32_t ror32(uint32_t x, uint32_t by) {
+    return by ? (x >> by) | (x << (32 - by)) : x;
+}
+
+void wheel_init(TimerWheel* w, uint32_t now) {
+    w->next = now + 1;
+    w->count = 0;
+    for (uint32_t l = 0; l < WHEEL_LEVELS; l++) {
+        w->pending[l] = 0;
+        for (uint32_t s = 0; s < WHEEL_SLOTS; s++) {
+            w->slots[l][s] = 0;
+        }
+    }
+}
+
+static HOT void wheel_place(TimerWheel* w, Timer* t) {
+    uint32_t expires = t->expires;
+    uint32_t delta = expires - w->next;
+    uint32_t level = 0;
+
+    if ((int32_t)delta < 0) {
+        expires = w->next;              // Overdue: the next tick processed
+        delta = 0;
+    } else if (delta >= WHEEL_SPAN) {
+        expires = w->next + WHEEL_SPAN - 1;     // Re-added when it gets there
+        delta = WHEEL_SPAN - 1;
+    }
+    while (delta >= 1u << level_shift(level + 1)) {
+        level++;
+    }
+
+    uint32_t index = (expires >> level_shift(level)) & SLOT_MASK;
+    timer_list_push(&w->slots[level][index], t);
+    w->pending[level] |= 1u << index;
+    t->slot = (uint8_t)(level * WHEEL_SLOTS + index);
+}
+
+HOT void wheel_add(TimerWheel* w, Timer* t) {
+    wheel_place(w, t);
+    w->count++;
+}
+
+HOT void wheel_del(TimerWheel* w, Timer* t) {
+    uint32_t level = t->slot / WHEEL_SLOTS;
+    uint32_t index = t->slot & SLOT_MASK;
+
+    timer_list_unlink(t);
+    if (!w->slots[level][index]) {
+        w->pending[level] &= ~(1u << index);
+    }
+    t->slot = WHEEL_NONE;
+    w->count--;
+}
+
+// Take a whole slot off the wheel; the caller re-places or expires it
+static Timer* wheel_take(TimerWheel* w, uint32_t level, uint32_t index) {
+    Timer* list = w->slots[level][index];
+
+    w->slots[level][index] = 0;
+    w->pending[level] &= ~(1u << index);
+    return list;
+}
+
+HOT Timer* wheel_advance(TimerWheel* w, uint32_t now) {
+    Timer* expired = 0;
+
+    if (w->count == 0) {
+        if ((int32_t)(now - w->next) >= 0) {
+            w->next = now + 1;
+        }
+        return 0;
+    }
+
+    while ((int32_t)(now - w->next) >= 0) {
+        uint32_t tick = w->next;
+
+        // Cascade every level whose slot starts at this tick, lowest first
+        for (uint32_t level = 1; level < WHEEL_LEVELS; level++) {
+            if (tick & ((1u << level_shift(level)) - 1)) {
+                break;
+            }
+            Timer* t = wheel_take(w, level, (tick >> level_shift(level)) & SLOT_MASK);
+            while (t) {
+                Timer* n = t->next;
+                wheel_place(w, t);
+                t = n;
+            }
+        }
+
+        Timer* t = wheel_take(w, 0, tick & SLOT_MASK);
+        while (t) {
+            Timer* n = t->next;
+            if ((int32_t)(t->expires - tick) > 0) {
+                wheel_place(w, t);      // Clamped at add time, not due yet
+            } else {
+                t->pprev = 0;
+                t->slot = WHEEL_NONE;
+                t->next = expired;
+                expired = t;
+                w->count--;
+            }
+            t = n;
+        }
+        w->next = tick + 1;
+    }
+    return expired;
+}
+
+int wheel_next(const TimerWheel* w, uint32_t* tick) {
+    if (w->count == 0) {
+        return 0;
+    }
+
+    uint32_t best = WHEEL_SPAN;         // Ticks from w->next
+    uint32_t m = ror32(w->pending[0], w->next & SLOT_MASK);
+    if (m) {
+        best = __builtin_ctz(m);
+    }
+
+    // A level-L slot is due when the wheel reaches the start of its span.
+    // Unless next is aligned, the current slot's span has already begun
+    // and its timers wait a full turn.
+    for (uint32_t level = 1; level < WHEEL_LEVELS; level++) {
+        uint32_t shift = level_shift(level);
+        uint32_t block = w->next >> shift;
+        m = ror32(w->pending[level], block & SLOT_MASK);
+        if (!m) {
+            continue;
+        }
+        uint32_t slots;
+        if ((m & 1) && (w->next & ((1u << shift) - 1))) {
+            m &= ~1u;
+            slots = m ? (uint32_t)__builtin_ctz(m) : WHEEL_SLOTS;
+        } else {
+            slots = __builtin_ctz(m);
+        }
+        uint32_t at = (block + slots) << shift;
+        if (at - w->next < best) {
+            best = at - w->next;
+        }
+    }
+
+    *tick = w->next + best;
+    return 1;
+}
@@ -0,0 +1,80 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+/*
+ * Hierarchical hashed timer wheel, in ticks. Level L has WHEEL_SLOTS
+ * slots of WHEEL_SLOTS^L ticks each; a timer goes on the lowest level
+ * whose span covers its delay and drops a level each time the wheel
+ * reaches its slot. Add and delete are O(1); a tick only looks at one
+ * level-0 slot, plus one slot per level every WHEEL_SLOTS^L ticks.
+ *
+ * The wheel has no lock of its own: its owner serialises every call.
+ */
+#define WHEEL_BITS      5
+#define WHEEL_SLOTS     (1u << WHEEL_BITS)      // One bit each in pending[]
+#define WHEEL_LEVELS    5                       // 2^25 ticks, ~93 h at 10 ms
+#define WHEEL_SPAN      (1u << (WHEEL_BITS * WHEEL_LEVELS))
+#define WHEEL_NONE      0xFF                    // Timer.slot: not on a wheel slot
+
+struct Timer;
+typedef void (*TimerCallback)(void* arg);
+
+typedef struct Timer {
+    struct Timer* next;
+    struct Timer** pprev;   // NULL while not queued anywhere
+    uint32_t expires;       // Tick
+    TimerCallback func;     // NULL for a task's sleep
+    void* arg;
+    uint8_t cpu;            // Core whose wheel it was added to
+    uint8_t slot;           // level * WHEEL_SLOTS + index, or WHEEL_NONE
+} Timer;
+
+typedef struct {
+    uint32_t next;          // Next tick to process
+    uint32_t count;         // Timers on the wheel
+    uint32_t pending[WHEEL_LEVELS];     // Bit i: slot i non-empty
+    Timer* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+} TimerWheel;
+
+static inline int timer_queued(const Timer* t) {
+    return t->pprev != 0;
+}
+
+// Doubly linked list push and unlink, shared by wheel slots and callers'
+// own lists of expired timers
+static inline void timer_list_push(Timer** head, Timer* t) {
+    t->next = *head;
+    if (*head) {
+        (*head)->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+}
+
+static inline void timer_list_unlink(Timer* t) {
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = 0;
+    t->pprev = 0;
+}
+
+// Ticks up to and including now count as processed
+void wheel_init(TimerWheel* w, uint32_t now);
+
+// t->expires set by the caller; one already due fires at the next advance
+void wheel_add(TimerWheel* w, Timer* t);
+void wheel_del(TimerWheel* w, Timer* t);
+
+// Process every tick up to and including now. Returns the expired
+// timers, unlinked and chained through next.
+Timer* wheel_advance(TimerWheel* w, uint32_t now);
+
+// Earliest tick with work: exact on level 0, the cascade tick above it.
+// 0 if the wheel is empty.
+int wheel_next(const TimerWheel* w, uint32_t* tick);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * smp.c - Bring-up of cores 1-3
+ *
+ * The firmware stub parks the secondary cores in a WFE loop polling
+ * their local mailbox 3 (the 64-bit stub: a spin table at 0xE0).
+ * Writing an address there releases the core, which then enters
+ * secondary_start in boot.S (own stacks, VBAR, MMU) and finally
+ * secondary_main().
+ */
+
+#include "smp.h"
+#include "../../drivers/uart/uart.h"
+#include "../interrupts/interrupts.h"
+#include "../scheduler/task.h"
+#include "../scheduler/fpu.h"
+#include "../mm/mmu.h"
+#ifdef SD_SERVICE_CORE
+#include "../../drivers/sd/sd_queue.h"
+#endif
+#include <stdatomic.h>
+
+extern void secondary_start(void);
+
+// boot.S: caches and MMU off, set parked[core], wait to be released again
+extern void smp_park(uint32_t core, volatile uint32_t* parked);
+
+static atomic_uint online_mask = 1;     // Core 0 is always up
+
+// Stored uncached by smp_park, so core 0 reads it around its own cache.
+// One line to itself: nothing else may be written back over it.
+static volatile uint32_t parked[CACHE_LINE_SIZE / 4] __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static void smp_delay_us(uint32_t us) {
+    uint32_t start = *SYSTIMER_CLO;
+    while ((*SYSTIMER_CLO - start) < us);
+}
+
+void smp_init(void) {
+    uart_puts("SMP: Releasing cores 1-3...\n");
+
+    for (uint32_t core = 1; core < NUM_CORES; core++) {
+#ifdef __aarch64__
+        // Polled with the caches off: push the entry out to RAM
+        *SPIN_TABLE(core) = (uintptr_t)secondary_start;
+        dcache_clean_range((const void*)SPIN_TABLE(core), sizeof(uint64_t));
+#else
+        *CORE_MBOX3_SET(core) = (uintptr_t)secondary_start;
+#endif
+    }
+    __asm__ __volatile__("dsb sy\n\tsev" ::: "memory");
+
+    // Give them up to 100 ms to check in
+    uint32_t start = *SYSTIMER_CLO;
+    while (atomic_load(&online_mask) != (1u << NUM_CORES) - 1 &&
+           (*SYSTIMER_CLO - start) < 100000) {
+        smp_delay_us(100);
+    }
+
+    uart_puts("SMP: Online mask = ");
+    uart_puthex(atomic_load(&online_mask));
+    uart_puts("\n");
+}
+
+uint32_t smp_online_mask(void) {
+    return atomic_load(&online_mask);
+}
+
+int smp_core_online(uint32_t core) {
+    return (atomic_load(&online_mask) >> core) & 1;
+}
+
+void smp_send_ipi(uint32_t core, uint32_t bits) {
+    __asm__ __volatile__("dsb sy" ::: "memory");
+    *LOCAL_MBOX0_SET(core) = bits;
+}
+
+static int parked_all(uint32_t cores) {
+    dcache_invalidate_range((const void*)parked, sizeof(parked));
+    for (uint32_t core = 1; core < NUM_CORES; core++) {
+        if ((cores >> core & 1) && !parked[core]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Leaving online_mask is not enough: the core still runs cached code
+ * and may write back dirty lines until smp_park has turned its caches
+ * off, and warm_restart clears BSS right after.
+ */
+int smp_park_secondaries(void) {
+    uint32_t cores = atomic_load(&online_mask) & ~1u;
+
+    for (uint32_t core = 1; core < NUM_CORES; core++) {
+        parked[core] = 0;
+    }
+    dcache_clean_range((const void*)parked, sizeof(parked));
+    dcache_invalidate_range((const void*)parked, sizeof(parked));
+
+    for (uint32_t core = 1; core < NUM_CORES; core++) {
+        if (cores >> core & 1) {
+            smp_send_ipi(core, IPI_PARK);
+        }
+    }
+    // The storage core polls from WFE
+    __asm__ __volatile__("sev");
+
+    uint32_t start = *SYSTIMER_CLO;
+    while (!parked_all(cores) && (*SYSTIMER_CLO - start) < 10000) {
+        smp_delay_us(10);
+    }
+    return parked_all(cores) && atomic_load(&online_mask) == 1 ? 0 : -1;
+}
+
+void smp_park_self(void) {
+    uint32_t core = cpu_id();
+
+    // Nothing new is scheduled here; parked[] says when it is safe
+    atomic_fetch_and(&online_mask, ~(1u << core));
+    smp_park(core, parked);
+}
+
+void smp_poll_park(void) {
+    uint32_t core = cpu_id();
+
+    if (*LOCAL_MBOX0_CLR(core) & IPI_PARK) {
+        *LOCAL_MBOX0_CLR(core) = IPI_PARK;
+        smp_park_self();
+    }
+}
+
+void secondary_main(uint32_t core) {
+    atomic_fetch_or(&online_mask, 1u << core);
+
+    // Mailbox 0 IRQ, for IPI_PARK
+    *LOCAL_MBOX_CNTL(core) = 1;
+
+#ifdef SD_SERVICE_CORE
+    // Storage core never joins the scheduler
+    if (core == SD_SERVICE_CORE) {
+        sd_service_main();
+    }
+#endif
+
+    fpu_init();
+    local_timer_init();
+    scheduler_start_secondary();
+}
@@ -0,0 +1,54 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+#define NUM_CORES           4
+
+// ARM local block (BCM2836/7)
+#define LOCAL_BASE          0x40000000
+// Mailbox 3 write-set: the firmware stub parks cores 1-3 polling it
+#define CORE_MBOX3_SET(n)   ((volatile uint32_t*)(uintptr_t)(LOCAL_BASE + 0x8C + 0x10 * (n)))
+// The 64-bit stub polls a spin table in low memory instead
+#define SPIN_TABLE(n)       ((volatile uint64_t*)(uintptr_t)(0xD8 + 8 * (n)))
+
+static inline uint32_t cpu_id(void) {
+#ifdef __aarch64__
+    uint64_t mpidr;
+    __asm__ __volatile__("mrs %0, mpidr_el1" : "=r"(mpidr));
+#else
+    uint32_t mpidr;
+    __asm__ __volatile__("mrc p15, 0, %0, c0, c0, 5" : "=r"(mpidr));
+#endif
+    return mpidr & 3;
+}
+
+// IPI reasons (bits in the target core's local mailbox 0)
+#define IPI_SD_COMPLETE     (1 << 0)
+#define IPI_PARK            (1 << 1)    // Warm restart: back to the stub loop
+#define IPI_RESCHED         (1 << 2)    // Work queued for an idle core
+
+// Wake cores 1-3 and wait for them to check in
+void smp_init(void);
+
+// Bitmask of cores that finished bring-up
+uint32_t smp_online_mask(void);
+int smp_core_online(uint32_t core);
+
+// Raise a mailbox IRQ on another core
+void smp_send_ipi(uint32_t core, uint32_t bits);
+
+// Warm restart: ask cores 1-3 to park and wait for them (core 0,
+// IRQs off). 0 once each has its caches and MMU off, -1 on timeout.
+int smp_park_secondaries(void);
+
+// Park the calling secondary core, never returns (IPI_PARK handler)
+void smp_park_self(void);
+
+// For cores running with IRQs masked: park if IPI_PARK is pending
+void smp_poll_park(void);
+
+// C entry for cores 1-3 (called from boot.S)
+void secondary_main(uint32_t core);
+
+#endif
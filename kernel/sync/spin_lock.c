@@ -1,19 +1,34 @@
 #include "spin_lock.h"
+#include "../interrupts/interrupts.h"
+#include "../hot.h"
 
 void spin_init(Spinlock* lock) {
     atomic_flag_clear(lock);
 }
 
-void spin_lock(Spinlock* lock) {
-    while (atomic_flag_test_and_set(lock)) {
-        // Busy-wait (spin)
+HOT void spin_lock(Spinlock* lock) {
+    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire)) {
+        // Sleep until the holder's SEV
+        __asm__ __volatile__("wfe");
     }
 }
 
 int spin_trylock(Spinlock* lock) {
-    return !atomic_flag_test_and_set(lock);
+    return !atomic_flag_test_and_set_explicit(lock, memory_order_acquire);
 }
 
-void spin_unlock(Spinlock* lock) {
-    atomic_flag_clear(lock);
-}
\ No newline at end of file
+HOT void spin_unlock(Spinlock* lock) {
+    atomic_flag_clear_explicit(lock, memory_order_release);
+    __asm__ __volatile__("dsb sy\n\tsev" ::: "memory");
+}
+
+HOT uint32_t spin_lock_irqsave(Spinlock* lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+HOT void spin_unlock_irqrestore(Spinlock* lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
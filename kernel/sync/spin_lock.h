@@ -14,5 +14,9 @@ void spin_lock(Spinlock* lock);
 int spin_trylock(Spinlock* lock);
 void spin_unlock(Spinlock* lock);
 
+// Also masks IRQs on this core; use for state touched from IRQ context
+uint32_t spin_lock_irqsave(Spinlock* lock);
+void spin_unlock_irqrestore(Spinlock* lock, uint32_t flags);
+
 
 #endif
\ No newline at end of file
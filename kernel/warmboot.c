@@ -0,0 +1,52 @@
+/*
+ * warmboot.c - Restart the kernel in place, skipping firmware and SD
+ * enumeration
+ *
+ * The handoff block is only trusted when _start was entered with
+ * WARM_MAGIC (boot_times.restart): RAM survives the watchdog reset, so
+ * a stale block is still there after a cold reboot.
+ */
+
+#include "warmboot.h"
+#include "boot_times.h"
+#include "interrupts/interrupts.h"
+#include "smp/smp.h"
+#include "../drivers/uart/uart.h"
+#include "../utils/string_utils.h"
+
+extern WarmHandoff __warm_handoff;      // linker.ld, .warmboot
+
+// boot.S: caches and MMU off, jump to _start with WARM_MAGIC
+extern void warm_restart(void);
+
+const WarmHandoff* warmboot_handoff(void) {
+    if (boot_times.restart != WARM_MAGIC || __warm_handoff.magic != WARM_MAGIC) {
+        return 0;
+    }
+    return &__warm_handoff;
+}
+
+int warm_reboot(void) {
+    uint32_t start = *SYSTIMER_CLO;
+    const WarmHandoff* prev = warmboot_handoff();
+    uint32_t restarts = prev ? prev->restarts + 1 : 1;
+
+    uint32_t flags = irq_save();
+    if (smp_park_secondaries() < 0) {
+        irq_restore(flags);
+        uart_puts("WARM: Cores did not park, online mask = ");
+        uart_puthex(smp_online_mask());
+        uart_puts("\n");
+        return -1;
+    }
+
+    memset(&__warm_handoff, 0, sizeof(__warm_handoff));
+    __warm_handoff.reboot_at = start;
+    __warm_handoff.restarts = restarts;
+    sd_save_state(&__warm_handoff.sd);
+    __warm_handoff.magic = WARM_MAGIC;
+
+    // Cleans the caches, so the handoff reaches RAM
+    warm_restart();
+    return -1;
+}
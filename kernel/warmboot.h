@@ -0,0 +1,30 @@
+#ifndef WARMBOOT_H
+#define WARMBOOT_H
+
+#include <stdint.h>
+#include "../drivers/sd/sd.h"
+
+/*
+ * Warm restart: re-enter _start without the firmware, passing state in a
+ * handoff block in RAM reserved by the linker script (.warmboot). The
+ * kernel image stays where it is; boot.S restores .data from the copy it
+ * took at cold boot and clears BSS as usual.
+ */
+
+#define WARM_MAGIC      0x5741524D      // "WARM", also in r0/x0 at _start
+
+typedef struct {
+    uint32_t magic;
+    uint32_t reboot_at;         // SYSTIMER_CLO when `reboot warm` ran
+    uint32_t restarts;          // Warm restarts since the last cold boot
+    SdState sd;                 // For sd_resume(); rca 0 if none
+} WarmHandoff;
+
+// Park cores 1-3, fill in the handoff and restart. Returns -1 only if
+// a secondary core would not park; the caller should reset cold then.
+int warm_reboot(void);
+
+// Handoff from the previous kernel, or NULL after a cold boot
+const WarmHandoff* warmboot_handoff(void);
+
+#endif
@@ -0,0 +1,572 @@
+#include "cmd_bench.h"
+#include "commands.h"
+#include "../../drivers/uart/uart.h"
+#include "../../kernel/interrupts/interrupts.h"
+#include "../../kernel/scheduler/task.h"
+#include "../../kernel/mm/mmu.h"
+#include "../../kernel/mm/kmalloc.h"
+#include "../../kernel/sync/spin_lock.h"
+#include "../../kernel/smp/smp.h"
+#if CONFIG_FATFS
+#include "../../kernel/fatfs/ff.h"
+#endif
+#include "../../utils/string_utils.h"
+#include "../../utils/cycles.h"
+
+#define BENCH_COPY_SIZE     16384
+#define BENCH_COPY_ROUNDS   16
+#define BENCH_SCHED_ROUNDS  10000
+#define BENCH_FS_ROUNDS     8
+#define BENCH_MEM_MAX       65536
+#define BENCH_MEM_BYTES     262144      // Bytes moved per size and routine
+#define BENCH_HOT_ROUNDS    1024
+#define BENCH_SWITCH_TICKS  100         // Ticks sampled per task count
+#define BENCH_FAIR_TICKS    300
+#define BENCH_FAIR_IO_US    1000        // Work per wakeup of the IO-bound task
+#define BENCH_IDLE_TICKS    100         // Quiet window per tick mode
+#define BENCH_IDLE_WAKES    50          // 1-tick sleeps timed per tick mode
+
+// Printed with the results so A32, Thumb-2 and A64 runs can be told apart
+#if defined(__aarch64__)
+#define BENCH_ISA   "A64"
+#elif defined(__thumb__)
+#define BENCH_ISA   "Thumb-2"
+#else
+#define BENCH_ISA   "A32"
+#endif
+
+static uint8_t bench_src[BENCH_COPY_SIZE];
+static uint8_t bench_dst[BENCH_COPY_SIZE];
+
+// Each workload returns elapsed microseconds
+typedef uint32_t (*BenchFunc)(void);
+
+/*
+ * uncached: the case may run with only this core's caches off. Uncached
+ * accesses do not snoop the other cores and exclusives on non-cacheable
+ * memory are not guaranteed on the A53, so that means no locks and no
+ * data another core writes.
+ */
+typedef struct {
+    const char* name;
+    BenchFunc func;
+    int uncached;
+} BenchCase;
+
+static uint32_t bench_memcpy(void) {
+    uint32_t start = *SYSTIMER_CLO;
+    for (int i = 0; i < BENCH_COPY_ROUNDS; i++) {
+        memcpy(bench_dst, bench_src, BENCH_COPY_SIZE);
+    }
+    return *SYSTIMER_CLO - start;
+}
+
+static uint32_t bench_sched(void) {
+    uint32_t start = *SYSTIMER_CLO;
+    for (int i = 0; i < BENCH_SCHED_ROUNDS; i++) {
+        scheduler_peek_next();
+    }
+    return *SYSTIMER_CLO - start;
+}
+
+#if CONFIG_FATFS
+// Directory walks: FatFs parsing out of fs->win[]
+static uint32_t bench_fatfs(void) {
+    DIR dir;
+    FILINFO fno;
+    uint32_t start = *SYSTIMER_CLO;
+
+    for (int i = 0; i < BENCH_FS_ROUNDS; i++) {
+        if (f_opendir(&dir, "/") != FR_OK) {
+            return 0;
+        }
+        while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != 0);
+        f_closedir(&dir);
+    }
+    return *SYSTIMER_CLO - start;
+}
+#endif
+
+static const BenchCase bench_cases[] = {
+    { "memcpy 256K", bench_memcpy, 1 },
+    { "sched x10k ", bench_sched,  1 },     // Lock-free peek at this core's queue
+#if CONFIG_FATFS
+    { "fatfs dir  ", bench_fatfs,  0 },     // Volume and SD queue locks
+#endif
+};
+
+static void print_padded(uint32_t val, int width) {
+    uint32_t tmp = val;
+    int digits = 1;
+    while (tmp >= 10) {
+        tmp /= 10;
+        digits++;
+    }
+    while (digits++ < width) uart_putc(' ');
+    uart_putdec(val);
+}
+
+// Prints a/b as "N.NNx"
+static void print_ratio(uint32_t a, uint32_t b) {
+    if (b == 0) {
+        uart_puts("    -");
+        return;
+    }
+    // No libgcc: stay in 32-bit division
+    uint32_t x100 = (a / b) * 100 + ((a % b) * 100) / b;
+    print_padded(x100 / 100, 5);
+    uart_putc('.');
+    uart_putc('0' + (x100 / 10) % 10);
+    uart_putc('0' + x100 % 10);
+    uart_putc('x');
+}
+
+// ============== BENCH MEM ==============
+static const uint32_t mem_sizes[] = {
+    1, 4, 16, 64, 256, 512, 1024, 4096, 16384, 65536
+};
+
+// The byte loop string_utils.c used before mem_arm.S, as the baseline
+static void byte_copy(void* dst, const void* src, size_t n) {
+    volatile uint8_t* d = dst;
+    const uint8_t* s = src;
+    while (n--) *d++ = *s++;
+}
+
+// Average cycles per call; op 0 byte loop, 1 memcpy, 2 misaligned
+// memcpy, 3 memset, 4 memcmp of equal buffers
+static uint32_t mem_time(int op, uint8_t* dst, uint8_t* src, uint32_t size) {
+    uint32_t rounds = BENCH_MEM_BYTES / size;
+    if (rounds > 4096) {
+        rounds = 4096;
+    }
+    volatile int sink = 0;
+
+    uint32_t t0 = cycles();
+    for (uint32_t i = 0; i < rounds; i++) {
+        switch (op) {
+        case 0: byte_copy(dst, src, size); break;
+        case 1: memcpy(dst, src, size); break;
+        case 2: memcpy(dst, src + 1, size); break;
+        case 3: memset(dst, 0, size); break;
+        default: sink += memcmp(dst, src, size); break;
+        }
+    }
+    (void)sink;
+    return (cycles() - t0) / rounds;
+}
+
+static void bench_mem(void) {
+    uint8_t* src = kmalloc(BENCH_MEM_MAX + 64);
+    uint8_t* dst = kmalloc(BENCH_MEM_MAX + 64);
+    if (!src || !dst) {
+        uart_puts("bench: out of memory\n");
+        kfree(src);
+        kfree(dst);
+        return;
+    }
+    for (uint32_t i = 0; i < BENCH_MEM_MAX + 64; i++) {
+        src[i] = (uint8_t)i;
+    }
+
+    cycles_enable();
+    uart_puts("\n  Cycles per call (caches on, " BENCH_ISA " build)\n");
+    uart_puts("     Size   Byte loop     memcpy  Speedup  memcpy+1     memset     memcmp\n");
+
+    for (uint32_t i = 0; i < sizeof(mem_sizes) / sizeof(mem_sizes[0]); i++) {
+        uint32_t size = mem_sizes[i];
+        uint32_t t[5];
+
+        disable_irq();
+        memcpy(dst, src, size);           // warm up, takes any FPU trap
+        for (int op = 0; op < 5; op++) {
+            if (op == 4) {
+                memcpy(dst, src, size);   // memcmp must walk the whole buffer
+            }
+            t[op] = mem_time(op, dst, src, size);
+        }
+        enable_irq();
+
+        print_padded(size, 9);
+        print_padded(t[0], 12);
+        print_padded(t[1], 11);
+        uart_puts("  ");
+        print_ratio(t[0], t[1]);
+        print_padded(t[2], 10);
+        print_padded(t[3], 11);
+        print_padded(t[4], 11);
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+
+    kfree(src);
+    kfree(dst);
+}
+
+// ============== BENCH HOT ==============
+static const char* const hot_names[] = {
+    "sched pick    ", "spinlock pair ", "kmalloc+kfree ", "memcpy 1K     "
+};
+
+// Average cycles per op: 0 scheduler_peek_next, 1 spin_lock_irqsave and
+// unlock, 2 kmalloc(64) + kfree, 3 memcpy of 1 KB
+static uint32_t hot_time(int op) {
+    static Spinlock lock = SPINLOCK_INIT;
+
+    uint32_t t0 = cycles();
+    for (uint32_t i = 0; i < BENCH_HOT_ROUNDS; i++) {
+        switch (op) {
+        case 0: scheduler_peek_next(); break;
+        case 1: spin_unlock_irqrestore(&lock, spin_lock_irqsave(&lock)); break;
+        case 2: kfree(kmalloc(64)); break;
+        default: memcpy(bench_dst, bench_src, 1024); break;
+        }
+    }
+    return (cycles() - t0) / BENCH_HOT_ROUNDS;
+}
+
+// The per-profile numbers for `make profile-report`
+static void bench_hot(void) {
+    cycles_enable();
+    uart_puts("\n  Hot paths, cycles per op (" CONFIG_PROFILE " profile, "
+              CONFIG_OPT ", " BENCH_ISA ")\n");
+
+    for (int op = 0; op < 4; op++) {
+        disable_irq();
+        hot_time(op);                     // warm up
+        uint32_t t = hot_time(op);
+        enable_irq();
+
+        uart_puts("  ");
+        uart_puts(hot_names[op]);
+        print_padded(t, 8);
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+}
+
+// ============== BENCH SCHED ==============
+static const uint32_t switch_counts[] = { 8, 64, 256 };
+static volatile int spinners_stop;
+
+static void spinner(void) {
+    while (!spinners_stop);
+}
+
+/*
+ * Background spinners at priority 0 on this core rotate on every tick
+ * while the shell sleeps above them; each tick is one IRQ-to-switch.
+ * The set grows between rounds, so only the task count changes.
+ */
+static void bench_switch(void) {
+    uint32_t cpu = task_current() ? task_current()->cpu : 0;
+    int base = task_count();
+    uint32_t live = 0;
+
+    cycles_enable();
+    spinners_stop = 0;
+    uart_puts("\n  IRQ-to-switch, cycles (core ");
+    uart_putdec(cpu);
+    uart_puts(", " CONFIG_PROFILE " profile, " BENCH_ISA ")\n");
+    uart_puts("    Tasks  Switches       Avg       Max\n");
+
+    for (uint32_t i = 0; i < sizeof(switch_counts) / sizeof(switch_counts[0]); i++) {
+        while (live < switch_counts[i]) {
+            if (task_create_sized("spin", spinner, 0, cpu, TASK_STACK_MIN) < 0) {
+                break;
+            }
+            live++;
+        }
+        if (live < switch_counts[i]) {
+            uart_puts("  bench: out of memory for tasks\n");
+            break;
+        }
+
+        SwitchTiming t;
+        switch_timing_start();
+        task_sleep(BENCH_SWITCH_TICKS);
+        switch_timing_stop(&t);
+
+        print_padded(live, 9);
+        print_padded(t.switches, 10);
+        print_padded(t.switches ? t.total / t.switches : 0, 10);
+        print_padded(t.max, 10);
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+
+    // Each exiting spinner hands straight on to the next
+    spinners_stop = 1;
+    while (task_count() > base) {
+        task_sleep(1);
+    }
+}
+
+// ============== BENCH FAIR ==============
+typedef struct {
+    const char* name;
+    int nice;
+    int io;                 // Sleeps a tick after each BENCH_FAIR_IO_US of work
+    Task* task;
+    uint32_t rounds;
+} FairWorker;
+
+static FairWorker fair_workers[] = {
+    { "cpu n0", 0, 0, 0, 0 },
+    { "cpu n0", 0, 0, 0, 0 },
+    { "cpu n5", 5, 0, 0, 0 },
+    { "io n0 ", 0, 1, 0, 0 },
+};
+static volatile int fair_stop;
+
+static void fair_worker(uint32_t i) {
+    FairWorker* w = &fair_workers[i];
+
+    w->task = task_current();
+    while (!fair_stop) {
+        if (w->io) {
+            uint32_t start = *SYSTIMER_CLO;
+            while (*SYSTIMER_CLO - start < BENCH_FAIR_IO_US);
+            task_sleep(1);
+        }
+        w->rounds++;
+    }
+}
+
+static void fair_worker_0(void) { fair_worker(0); }
+static void fair_worker_1(void) { fair_worker(1); }
+static void fair_worker_2(void) { fair_worker(2); }
+static void fair_worker_3(void) { fair_worker(3); }
+
+static const TaskFunction fair_funcs[] = {
+    fair_worker_0, fair_worker_1, fair_worker_2, fair_worker_3
+};
+
+// Prints a per-mille value as "NN.N%"
+static void print_permille(uint32_t pm, int width) {
+    print_padded(pm / 10, width - 3);
+    uart_putc('.');
+    uart_putc('0' + pm % 10);
+    uart_putc('%');
+}
+
+/*
+ * CPU-bound fair tasks should split what the IO-bound one leaves in
+ * proportion to their weights; the IO-bound one should get its ~10%
+ * (1 ms per 10 ms tick) despite sharing the class with spinners.
+ */
+static void bench_fair(void) {
+    const uint32_t n = sizeof(fair_workers) / sizeof(fair_workers[0]);
+    uint32_t cpu = task_current() ? task_current()->cpu : 0;
+    int base = task_count();
+
+    fair_stop = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        fair_workers[i].task = 0;
+        fair_workers[i].rounds = 0;
+        if (task_create_fair(fair_workers[i].name, fair_funcs[i], fair_workers[i].nice, cpu) < 0) {
+            uart_puts("bench: out of memory for tasks\n");
+            fair_stop = 1;
+            return;
+        }
+    }
+
+    // The shell outranks the fair class, so nothing runs behind our back
+    // while the shares are read
+    SwitchTiming t;
+    switch_timing_start();
+    task_sleep(BENCH_FAIR_TICKS);
+    switch_timing_stop(&t);
+
+    // Runtimes in 4K-cycle units keep the maths in 32 bits
+    uint32_t run[sizeof(fair_workers) / sizeof(fair_workers[0])];
+    uint32_t total = 0, io_run = 0, cpu_weight = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        run[i] = fair_workers[i].task ? (uint32_t)(fair_workers[i].task->runtime >> 12) : 0;
+        total += run[i];
+        if (fair_workers[i].io) {
+            io_run += run[i];
+        } else {
+            cpu_weight += task_nice_weight(fair_workers[i].nice);
+        }
+    }
+    if (total == 0) {
+        total = 1;
+    }
+    uint32_t cpu_share = 1000 - io_run * 1000 / total;
+
+    uart_puts("\n  Fair share, ");
+    uart_putdec(BENCH_FAIR_TICKS);
+    uart_puts(" ticks on core ");
+    uart_putdec(cpu);
+    uart_puts(" (" CONFIG_PROFILE " profile, " BENCH_ISA ")\n");
+    uart_puts("  Task     Weight    Share  Expected    Rounds\n");
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t weight = task_nice_weight(fair_workers[i].nice);
+        uart_puts("  ");
+        uart_puts(fair_workers[i].name);
+        print_padded(weight, 8);
+        print_permille(run[i] * 1000 / total, 9);
+        if (fair_workers[i].io) {
+            uart_puts("         -");
+        } else {
+            print_permille(cpu_share * weight / cpu_weight, 10);
+        }
+        print_padded(fair_workers[i].rounds, 10);
+        uart_puts("\n");
+    }
+    uart_puts("  IRQ-to-switch: ");
+    uart_putdec(t.switches);
+    uart_puts(" switches, avg ");
+    uart_putdec(t.switches ? t.total / t.switches : 0);
+    uart_puts(" cycles, max ");
+    uart_putdec(t.max);
+    uart_puts("\n\n");
+
+    fair_stop = 1;
+    while (task_count() > base) {
+        task_sleep(1);
+    }
+}
+
+// ============== BENCH IDLE ==============
+/*
+ * Periodic tick against tickless idle. The shell sleeps through a quiet
+ * window to sample IRQ rate and idle residency on every core, then
+ * times 1-tick sleeps from the tick boundary to running again.
+ */
+static void bench_idle(void) {
+    static const char* const mode_names[] = { "periodic", "tickless" };
+    int saved = scheduler_tickless();
+    Task* self = task_current();
+
+    if (!self) {
+        return;
+    }
+
+    uart_puts("\n  Idle, ");
+    uart_putdec(BENCH_IDLE_TICKS);
+    uart_puts(" quiet ticks and ");
+    uart_putdec(BENCH_IDLE_WAKES);
+    uart_puts(" timed wakeups per mode (" CONFIG_PROFILE " profile, " BENCH_ISA ")\n");
+    uart_puts("  Tick      IRQs per second       Idle residency            Wake late us\n");
+    uart_puts("             c0   c1   c2   c3    c0     c1     c2     c3      avg   max\n");
+
+    for (int mode = 0; mode < 2; mode++) {
+        uint32_t irqs[NUM_CORES], idle[NUM_CORES];
+
+        scheduler_set_tickless(mode);
+        task_sleep(1);
+
+        for (uint32_t c = 0; c < NUM_CORES; c++) {
+            irqs[c] = irq_count(c);
+            idle[c] = scheduler_idle_us(c);
+        }
+        uint32_t start = *SYSTIMER_CLO;
+        task_sleep(BENCH_IDLE_TICKS);
+        uint32_t elapsed_ms = (*SYSTIMER_CLO - start) / 1000;
+        if (elapsed_ms == 0) {
+            elapsed_ms = 1;
+        }
+        for (uint32_t c = 0; c < NUM_CORES; c++) {
+            irqs[c] = irq_count(c) - irqs[c];
+            idle[c] = scheduler_idle_us(c) - idle[c];
+        }
+
+        uint32_t late_sum = 0, late_max = 0;
+        for (int i = 0; i < BENCH_IDLE_WAKES; i++) {
+            task_sleep(1);
+            uint32_t flags = irq_save();
+            uint32_t late = *SYSTIMER_CLO - tick_time_us(self->sleep_until);
+            irq_restore(flags);
+            if ((int32_t)late < 0) {
+                late = 0;       // Within the tick slack
+            }
+            late_sum += late;
+            if (late > late_max) {
+                late_max = late;
+            }
+        }
+
+        uart_puts("  ");
+        uart_puts(mode_names[mode]);
+        for (uint32_t c = 0; c < NUM_CORES; c++) {
+            print_padded(irqs[c] * 1000 / elapsed_ms, 5);
+        }
+        for (uint32_t c = 0; c < NUM_CORES; c++) {
+            uint32_t pm = idle[c] / elapsed_ms;
+            print_permille(pm > 1000 ? 1000 : pm, 7);
+        }
+        print_padded(late_sum / BENCH_IDLE_WAKES, 8);
+        print_padded(late_max, 6);
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+
+    scheduler_set_tickless(saved);
+}
+
+// ============== BENCH ==============
+void cmd_bench(const char* args) {
+    if (str_startswith(args, "mem")) {
+        bench_mem();
+        return;
+    }
+    if (str_startswith(args, "hot")) {
+        bench_hot();
+        return;
+    }
+    if (str_startswith(args, "sched")) {
+        bench_switch();
+        return;
+    }
+    if (str_startswith(args, "fair")) {
+        bench_fair();
+        return;
+    }
+    if (str_startswith(args, "idle")) {
+        bench_idle();
+        return;
+    }
+
+    uart_puts("\n  " BENCH_ISA " build, " CONFIG_PROFILE " profile (" CONFIG_OPT ")\n");
+    uart_puts("  Workload      Uncached us    Cached us   Speedup\n");
+    uart_puts("  --------      -----------    ---------   -------\n");
+
+    for (uint32_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+        const BenchCase* bc = &bench_cases[i];
+
+        // No preemption while timing; caches off only for the first run
+        uint32_t t_off = 0;
+        disable_irq();
+        if (bc->uncached) {
+            cache_disable();
+            t_off = bc->func();
+            cache_enable();
+        }
+        bc->func();                       // warm up
+        uint32_t t_on = bc->func();
+        enable_irq();
+
+        uart_puts("  ");
+        uart_puts(bc->name);
+        if (bc->uncached) {
+            print_padded(t_off, 15);
+        } else {
+            uart_puts("              -");
+        }
+        print_padded(t_on, 13);
+        uart_puts("  ");
+        if (bc->uncached) {
+            print_ratio(t_off, t_on);
+        } else {
+            uart_puts("    -");
+        }
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+}
+
+void cmd_bench_init(void) {
+    register_command("bench", "bench", "Cache on/off benchmarks (bench mem | hot | sched | fair | idle)", cmd_bench);
+}
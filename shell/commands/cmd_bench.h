@@ -0,0 +1,10 @@
+#ifndef CMD_BENCH_H
+#define CMD_BENCH_H
+
+// Command handlers
+void cmd_bench(const char* args);
+
+// Register benchmark commands
+void cmd_bench_init(void);
+
+#endif
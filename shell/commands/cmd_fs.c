@@ -3,22 +3,51 @@
 #include "commands.h"
 #include "../../drivers/uart/uart.h"
 #include "../../utils/string_utils.h"
+#include "../../kernel/mm/kmalloc.h"
+#include "../../kernel/mm/slab.h"
+#include "../../kernel/mm/mmu.h"
+
+#define CAT_BUF_SIZE 512        // One sector per f_read
+
+// FatFs objects come from their own caches instead of the task stack
+static kmem_cache_t* fil_cache;
+static kmem_cache_t* dir_cache;
+
+// FIL carries a full sector buffer; keep it off the 4 KB task stack
+static FIL* file_alloc(const char* cmd) {
+    FIL* file = kmem_cache_alloc(fil_cache);
+    if (!file) {
+        uart_puts(cmd);
+        uart_puts(": out of memory\n");
+    }
+    return file;
+}
+
+static void file_free(FIL* file) {
+    kmem_cache_free(fil_cache, file);
+}
 
 void cmd_ls(const char* args) {
     (void)args;
 
-    DIR dir;
+    DIR* dir = kmem_cache_alloc(dir_cache);
     FILINFO fno;
     FRESULT res;
 
-    res = f_opendir(&dir, "/");
+    if (!dir) {
+        uart_puts("ls: out of memory\n");
+        return;
+    }
+
+    res = f_opendir(dir, "/");
     if (res != FR_OK) {
         uart_puts("ls: failed to open directory\n");
+        kmem_cache_free(dir_cache, dir);
         return;
     }
 
     while (1) {
-        res = f_readdir(&dir, &fno);
+        res = f_readdir(dir, &fno);
         if (res != FR_OK || fno.fname[0] == 0) break;
 
         if (fno.fattrib & AM_DIR)
@@ -30,7 +59,8 @@ void cmd_ls(const char* args) {
         uart_puts("\n");
     }
 
-    f_closedir(&dir);
+    f_closedir(dir);
+    kmem_cache_free(dir_cache, dir);
 }
 
 void cmd_cat(const char* args) {
@@ -39,37 +69,58 @@ void cmd_cat(const char* args) {
         return;
     }
 
-    FIL file;
-    char buf[64];
+    FIL* file = file_alloc("cat");
+    if (!file) {
+        return;
+    }
+
+    char* buf = kmalloc(CAT_BUF_SIZE + 1);
     UINT br;
 
-    if (f_open(&file, args, FA_READ) != FR_OK) {
+    if (!buf) {
+        uart_puts("cat: out of memory\n");
+        file_free(file);
+        return;
+    }
+
+    if (f_open(file, args, FA_READ) != FR_OK) {
         uart_puts("cat: cannot open file\n");
+        kfree(buf);
+        file_free(file);
         return;
     }
 
-    while (f_read(&file, buf, sizeof(buf)-1, &br) == FR_OK && br > 0) {
+    while (f_read(file, buf, CAT_BUF_SIZE, &br) == FR_OK && br > 0) {
         buf[br] = 0;
         uart_puts(buf);
     }
 
     uart_puts("\n");
-    f_close(&file);
+    f_close(file);
+    kfree(buf);
+    file_free(file);
 }
 
+// Writers; a read-only FatFs build (CONFIG_FF_READONLY) has only ls and cat
+#if !FF_FS_READONLY
 void cmd_touch(const char* args) {
     if (!args || args[0] == 0) {
         uart_puts("Usage: touch <file>\n");
         return;
     }
 
-    FIL file;
-    if (f_open(&file, args, FA_CREATE_ALWAYS) == FR_OK) {
-        f_close(&file);
+    FIL* file = file_alloc("touch");
+    if (!file) {
+        return;
+    }
+
+    if (f_open(file, args, FA_CREATE_ALWAYS) == FR_OK) {
+        f_close(file);
         uart_puts("File created\n");
     } else {
         uart_puts("touch: failed\n");
     }
+    file_free(file);
 }
 
 void cmd_write(const char* args) {
@@ -78,35 +129,46 @@ void cmd_write(const char* args) {
         return;
     }
 
-    char filename[32];
     const char* text;
 
     // Split args
     int i = 0;
     while (args[i] && args[i] != ' ') {
-        filename[i] = args[i];
         i++;
     }
-    filename[i] = 0;
-
-    text = args + i + 1;
-    if (!*text) {
+    if (!args[i] || !args[i + 1]) {
         uart_puts("write: no text\n");
         return;
     }
+    text = args + i + 1;
+
+    // Sized to the name, so long names are no longer truncated/overrun
+    FIL* file = file_alloc("write");
+    if (!file) {
+        return;
+    }
 
-    FIL file;
+    char* filename = kmalloc(i + 1);
     UINT bw;
 
-    if (f_open(&file, filename, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
-        uart_puts("write: open failed\n");
+    if (!filename) {
+        uart_puts("write: out of memory\n");
+        file_free(file);
         return;
     }
+    memcpy(filename, args, i);
+    filename[i] = 0;
 
-    f_write(&file, text, str_len(text), &bw);
-    f_close(&file);
+    if (f_open(file, filename, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+        uart_puts("write: open failed\n");
+    } else {
+        f_write(file, text, str_len(text), &bw);
+        f_close(file);
+        uart_puts("Written OK\n");
+    }
 
-    uart_puts("Written OK\n");
+    kfree(filename);
+    file_free(file);
 }
 
 void cmd_rm(const char* args) {
@@ -132,14 +194,22 @@ void cmd_mkdir(const char* args) {
     else
         uart_puts("mkdir: failed\n");
 }
-
+#endif
 
 void cmd_fs_init(){
-    
+    fil_cache = kmem_cache_create("FIL", sizeof(FIL), CACHE_LINE_SIZE, 0);
+    dir_cache = kmem_cache_create("DIR", sizeof(DIR), 0, 0);
+    if (!fil_cache || !dir_cache) {
+        uart_puts("FS: Out of memory for FIL/DIR caches, file commands disabled\n");
+        return;
+    }
+
     register_command("ls",    "ls",    "List files",        cmd_ls);
     register_command("cat",   "cat",   "Show file content", cmd_cat);
+#if !FF_FS_READONLY
     register_command("touch", "touch", "Create empty file", cmd_touch);
     register_command("write", "write", "Write text to file",cmd_write);
     register_command("rm",    "rm",    "Delete file",       cmd_rm);
     register_command("mkdir", "mkdir", "Create directory", cmd_mkdir);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "cmd_mem.h"
+#include "commands.h"
+#include "../../drivers/uart/uart.h"
+#include "../../kernel/mm/page_alloc.h"
+#include "../../kernel/mm/kmalloc.h"
+#include "../../kernel/mm/slab.h"
+#include "../../kernel/mm/alloc_trace.h"
+#include "../../utils/string_utils.h"
+#include "../../utils/cycles.h"
+#include "../../kernel/interrupts/interrupts.h"
+
+#define KMTEST_ROUNDS   20000
+#define KMTEST_SLOTS    64
+
+// ============== MEMINFO ==============
+void cmd_meminfo(const char* args) {
+    (void)args;
+
+    page_stats_t st;
+    page_get_stats(&st);
+
+    uart_puts("\n");
+    uart_puts("  ARM memory:  ");
+    uart_putdec(st.arm_size >> 20);
+    uart_puts(" MB at ");
+    uart_puthex(st.arm_base);
+    uart_puts("\n  Page pool:   ");
+    uart_puthex(st.pool_start);
+    uart_puts(" - ");
+    uart_puthex(st.pool_end);
+    uart_puts("\n  Pages:       ");
+    uart_putdec(st.free_pages);
+    uart_puts(" free / ");
+    uart_putdec(st.total_pages);
+    uart_puts(" total (");
+    uart_putdec((st.free_pages * (PAGE_SIZE / 1024)) / 1024);
+    uart_puts(" MB free)\n\n");
+
+    uart_puts("  Order  Block     Free blocks\n");
+    uart_puts("  -----  -----     -----------\n");
+    for (uint32_t o = 0; o <= PAGE_MAX_ORDER; o++) {
+        uint32_t kb = (PAGE_SIZE / 1024) << o;
+
+        uart_puts("  ");
+        uart_putdec(o);
+        uart_puts(o < 10 ? "      " : "     ");
+        uart_putdec(kb);
+        uart_puts(kb < 10 ? " KB      " : kb < 100 ? " KB     " : kb < 1000 ? " KB    " : " KB   ");
+        uart_putdec(st.free_blocks[o]);
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+}
+
+// ============== HEAPINFO ==============
+void cmd_heapinfo(const char* args) {
+    (void)args;
+
+    kmalloc_stats_t st;
+    kmalloc_get_stats(&st);
+
+    uart_puts("\n  Heap:          ");
+    uart_putdec(st.heap_bytes >> 10);
+    uart_puts(" KB in ");
+    uart_putdec(st.pools);
+    uart_puts(" pool(s)\n  Used:          ");
+    uart_putdec(st.used_bytes);
+    uart_puts(" bytes (peak ");
+    uart_putdec(st.peak_bytes);
+    uart_puts(")\n  Free:          ");
+    uart_putdec(st.free_bytes);
+    uart_puts(" bytes in ");
+    uart_putdec(st.free_blocks);
+    uart_puts(" block(s), largest ");
+    uart_putdec(st.largest_free);
+    uart_puts("\n  Fragmentation: ");
+    uart_putdec(st.frag_pct);
+    uart_puts("%\n  Calls:         ");
+    uart_putdec(st.allocs);
+    uart_puts(" alloc, ");
+    uart_putdec(st.frees);
+    uart_puts(" free, ");
+    uart_putdec(st.failures);
+    uart_puts(" failed\n\n");
+}
+
+// ============== SLABINFO ==============
+static void print_col(uint32_t val, int width) {
+    uint32_t tmp = val;
+    int digits = 1;
+    while (tmp >= 10) {
+        tmp /= 10;
+        digits++;
+    }
+    while (digits++ < width) uart_putc(' ');
+    uart_putdec(val);
+}
+
+void cmd_slabinfo(const char* args) {
+    (void)args;
+
+    slab_stats_t st;
+
+    uart_puts("\n  Cache           Size  Per  Slabs  Active  Total     Hits  Misses\n");
+    uart_puts("  -----           ----  ---  -----  ------  -----     ----  ------\n");
+
+    for (uint32_t i = 0; slab_get_stats(i, &st) == 0; i++) {
+        int len = 0;
+        uart_puts("  ");
+        uart_puts(st.name);
+        while (st.name[len]) len++;
+        while (len++ < 12) uart_putc(' ');
+
+        print_col(st.obj_size, 7);
+        print_col(st.per_slab, 5);
+        print_col(st.slabs, 7);
+        print_col(st.active, 8);
+        print_col(st.total, 7);
+        print_col(st.hits, 9);
+        print_col(st.misses, 8);
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+}
+
+// ============== KMTEST ==============
+static uint32_t parse_uint(const char* s, uint32_t fallback) {
+    uint32_t v = 0;
+    if (!s || *s < '0' || *s > '9') {
+        return fallback;
+    }
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (uint32_t)(*s++ - '0');
+    }
+    return v;
+}
+
+// Mostly small objects, some buffers, a few large blocks
+static uint32_t kmtest_size(uint32_t r) {
+    uint32_t pick = r % 100;
+    if (pick < 75) return 1 + (r >> 8) % 256;
+    if (pick < 95) return 257 + (r >> 8) % 3840;
+    return 4097 + (r >> 8) % 61440;
+}
+
+static void kmtest_fill(uint8_t* p, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        p[i] = (uint8_t)(seed + i);
+    }
+}
+
+static int kmtest_verify(const uint8_t* p, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (p[i] != (uint8_t)(seed + i)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void print_op(const char* name, uint32_t count, uint32_t total, uint32_t max) {
+    uart_puts("  ");
+    uart_puts(name);
+    uart_putdec(count);
+    uart_puts(" ops, avg ");
+    uart_putdec(count ? total / count : 0);
+    uart_puts(" cycles, max ");
+    uart_putdec(max);
+    uart_puts("\n");
+}
+
+// Randomised kmalloc/krealloc/kfree with pattern checks and per-call timing
+void cmd_kmtest(const char* args) {
+    static uint8_t* ptrs[KMTEST_SLOTS];
+    static uint32_t lens[KMTEST_SLOTS];
+
+    uint32_t rounds = parse_uint(args, KMTEST_ROUNDS);
+    uint32_t seed = 0x1234567;
+    uint32_t corrupt = 0, nomem = 0;
+    uint32_t n_alloc = 0, n_free = 0, n_realloc = 0;
+    uint32_t max_alloc = 0, max_free = 0, max_realloc = 0;
+    uint32_t sum_alloc = 0, sum_free = 0, sum_realloc = 0;
+
+    kmalloc_stats_t before;
+    kmalloc_get_stats(&before);
+    cycles_enable();
+
+    uart_puts("\n  kmtest: ");
+    uart_putdec(rounds);
+    uart_puts(" rounds, ");
+    uart_putdec(KMTEST_SLOTS);
+    uart_puts(" slots\n");
+
+    uint32_t start = *SYSTIMER_CLO;
+
+    for (uint32_t i = 0; i < rounds; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 16) % KMTEST_SLOTS;
+        uint32_t r = seed ^ (seed >> 13);
+
+        if (!ptrs[slot]) {
+            uint32_t len = kmtest_size(r);
+            uint32_t flags = irq_save();
+            uint32_t t0 = cycles();
+            uint8_t* p = kmalloc(len);
+            uint32_t t = cycles() - t0;
+            irq_restore(flags);
+
+            sum_alloc += t;
+            if (t > max_alloc) max_alloc = t;
+            n_alloc++;
+
+            if (!p) {
+                nomem++;
+                continue;
+            }
+            kmtest_fill(p, len, (uint8_t)slot);
+            ptrs[slot] = p;
+            lens[slot] = len;
+        } else if ((r & 7) == 0) {
+            uint32_t len = kmtest_size(r >> 3);
+            uint32_t keep = len < lens[slot] ? len : lens[slot];
+
+            if (kmtest_verify(ptrs[slot], lens[slot], (uint8_t)slot)) corrupt++;
+
+            uint32_t flags = irq_save();
+            uint32_t t0 = cycles();
+            uint8_t* p = krealloc(ptrs[slot], len);
+            uint32_t t = cycles() - t0;
+            irq_restore(flags);
+
+            sum_realloc += t;
+            if (t > max_realloc) max_realloc = t;
+            n_realloc++;
+
+            if (!p) {
+                nomem++;
+                continue;
+            }
+            if (kmtest_verify(p, keep, (uint8_t)slot)) corrupt++;
+            kmtest_fill(p, len, (uint8_t)slot);
+            ptrs[slot] = p;
+            lens[slot] = len;
+        } else {
+            if (kmtest_verify(ptrs[slot], lens[slot], (uint8_t)slot)) corrupt++;
+
+            uint32_t flags = irq_save();
+            uint32_t t0 = cycles();
+            kfree(ptrs[slot]);
+            uint32_t t = cycles() - t0;
+            irq_restore(flags);
+
+            sum_free += t;
+            if (t > max_free) max_free = t;
+            n_free++;
+            ptrs[slot] = 0;
+        }
+    }
+
+    for (uint32_t s = 0; s < KMTEST_SLOTS; s++) {
+        if (ptrs[s]) {
+            if (kmtest_verify(ptrs[s], lens[s], (uint8_t)s)) corrupt++;
+            kfree(ptrs[s]);
+            ptrs[s] = 0;
+        }
+    }
+
+    uint32_t elapsed = *SYSTIMER_CLO - start;
+
+    kmalloc_stats_t after;
+    kmalloc_get_stats(&after);
+
+    print_op("kmalloc  ", n_alloc, sum_alloc, max_alloc);
+    print_op("krealloc ", n_realloc, sum_realloc, max_realloc);
+    print_op("kfree    ", n_free, sum_free, max_free);
+
+    uart_puts("  Elapsed:    ");
+    uart_putdec(elapsed);
+    uart_puts(" us\n  Corrupted:  ");
+    uart_putdec(corrupt);
+    uart_puts("\n  No memory:  ");
+    uart_putdec(nomem);
+    uart_puts("\n  Leaked:     ");
+    uart_putdec(after.used_bytes - before.used_bytes);
+    uart_puts(" bytes\n  Consistent: ");
+    uart_puts(kmalloc_check() == 0 ? "yes" : "NO");
+    uart_puts("\n\n");
+}
+
+#ifdef ALLOC_TRACE
+// ============== ALLOCS ==============
+void cmd_allocs(const char* args) {
+    if (!args || args[0] == 0 || str_cmp(args, "bytes") == 0) {
+        alloc_trace_report(10, 1);
+    } else if (str_cmp(args, "count") == 0) {
+        alloc_trace_report(10, 0);
+    } else if (str_cmp(args, "live") == 0) {
+        alloc_trace_live();
+    } else if (str_cmp(args, "mark") == 0) {
+        alloc_trace_mark();
+        uart_puts("Mark set\n");
+    } else if (str_cmp(args, "reset") == 0) {
+        alloc_trace_reset();
+        uart_puts("Trace cleared\n");
+    } else {
+        uart_puts("Usage: allocs [bytes|count|live|mark|reset]\n");
+    }
+}
+#endif
+
+void cmd_mem_init(void) {
+    register_command("meminfo", "meminfo", "Free pages per order", cmd_meminfo);
+    register_command("heapinfo", "heapinfo", "kmalloc heap statistics", cmd_heapinfo);
+    register_command("slabinfo", "slabinfo", "Object cache usage", cmd_slabinfo);
+    register_command("kmtest", "kmtest", "kmalloc stress test [rounds]", cmd_kmtest);
+#ifdef ALLOC_TRACE
+    register_command("allocs", "allocs", "Allocation sites / live blocks", cmd_allocs);
+#endif
+}
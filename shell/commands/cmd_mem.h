@@ -0,0 +1,16 @@
+#ifndef CMD_MEM_H
+#define CMD_MEM_H
+
+// Command handlers
+void cmd_meminfo(const char* args);
+void cmd_heapinfo(const char* args);
+void cmd_slabinfo(const char* args);
+void cmd_kmtest(const char* args);
+#ifdef ALLOC_TRACE
+void cmd_allocs(const char* args);
+#endif
+
+// Register memory commands
+void cmd_mem_init(void);
+
+#endif
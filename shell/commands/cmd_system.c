@@ -2,7 +2,11 @@
 #include "commands.h"
 #include "../../drivers/uart/uart.h"
 #include "../../kernel/interrupts/interrupts.h"
+#include "../../kernel/init/initcall.h"
+#include "../../kernel/warmboot.h"
 #include "../../utils/string_utils.h"
+#include "../../kernel/gcov/gcov.h"
+#include "../../drivers/semihost/semihost.h"
 
 // ============== HELP ==============
 void cmd_help(const char* args) {
@@ -36,7 +40,21 @@ void cmd_info(const char* args) {
     uart_puts("║       System Info            ║\n");
     uart_puts("╠══════════════════════════════╣\n");
     uart_puts("║  OS:     SriOS               ║\n");
+#if defined(__aarch64__)
+    uart_puts("║  CPU:    Cortex-A53 (64-bit) ║\n");
+    uart_puts("║  ISA:    A64                 ║\n");
+#elif defined(__thumb__)
     uart_puts("║  CPU:    Cortex-A53 (32-bit) ║\n");
+    uart_puts("║  ISA:    Thumb-2             ║\n");
+#else
+    uart_puts("║  CPU:    Cortex-A53 (32-bit) ║\n");
+    uart_puts("║  ISA:    A32                 ║\n");
+#endif
+    uart_puts("║  Build:  " CONFIG_PROFILE " " CONFIG_OPT);
+    for (int pad = 20 - str_len(CONFIG_PROFILE " " CONFIG_OPT); pad > 0; pad--) {
+        uart_putc(' ');
+    }
+    uart_puts("║\n");
     uart_puts("║  Board:  Pi Zero 2W          ║\n");
     uart_puts("║  RAM:    512 MB              ║\n");
     uart_puts("╚══════════════════════════════╝\n");
@@ -80,9 +98,20 @@ void cmd_clear(const char* args) {
     uart_puts("\033[2J\033[H");
 }
 
+// ============== BOOTLOG ==============
+void cmd_bootlog(const char* args) {
+    (void)args;
+    bootlog_report();
+}
+
 // ============== REBOOT ==============
 void cmd_reboot(const char* args) {
-    (void)args;
+    if (str_cmp(args, "warm") == 0) {
+        uart_puts("Warm restart...\n");
+        warm_reboot();
+        uart_puts("Warm restart failed, doing a full reset\n");
+    }
+
     uart_puts("Rebooting...\n");
     
     #define PM_BASE     0x3F100000
@@ -97,11 +126,32 @@ void cmd_reboot(const char* args) {
     while (1);
 }
 
+#ifdef SEMIHOSTING
+// ============== POWEROFF ==============
+// Ends QEMU (-semihosting); a PGO=gen kernel writes its profile first
+void cmd_poweroff(const char* args) {
+    (void)args;
+
+    int files = gcov_dump();
+    if (files) {
+        uart_puts("Profile written: ");
+        uart_putdec(files);
+        uart_puts(" .gcda files\n");
+    }
+    uart_puts("Powering off\n");
+    semihost_exit();
+}
+#endif
+
 // Register all system commands
 void cmd_system_init(void) {
     register_command("help",   "help",   "Show available commands", cmd_help);
     register_command("info",   "info",   "System information",      cmd_info);
     register_command("uptime", "uptime", "Show system uptime",      cmd_uptime);
     register_command("clear",  "clear",  "Clear screen",            cmd_clear);
-    register_command("reboot", "reboot", "Reboot system",           cmd_reboot);
+    register_command("bootlog", "bootlog", "Boot phase timing",     cmd_bootlog);
+    register_command("reboot", "reboot", "Reboot ('reboot warm' skips firmware)", cmd_reboot);
+#ifdef SEMIHOSTING
+    register_command("poweroff", "poweroff", "Exit QEMU (writes the PGO profile)", cmd_poweroff);
+#endif
 }
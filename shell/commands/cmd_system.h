@@ -6,7 +6,9 @@ void cmd_info(const char* args);
 void cmd_help(const char* args);
 void cmd_uptime(const char* args);
 void cmd_clear(const char* args);
+void cmd_bootlog(const char* args);
 void cmd_reboot(const char* args);
+void cmd_poweroff(const char* args);
 
 // Register all system commands
 void cmd_system_init(void);
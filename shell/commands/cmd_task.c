@@ -0,0 +1,232 @@
+#include "cmd_task.h"
+#include "commands.h"
+#include "../../drivers/uart/uart.h"
+#include "../../kernel/scheduler/task.h"
+#include "../../kernel/scheduler/fpu.h"
+#include "../../kernel/interrupts/interrupts.h"
+#include "../../utils/string_utils.h"
+
+#define SPAWN_DEFAULT_STACK 1024
+#define SPAWN_LIFETIME      100     // Ticks each spawned task lives
+#define FPUTEST_ROUNDS      50
+#define TIMERTEST_COUNT     6
+#define TIMERTEST_SLACK     2       // Ticks a callback may run late
+#define TIMERTEST_CANCEL    4       // Index cancelled while pending
+#define TIMERTEST_REARM     2       // Index re-armed while pending...
+#define TIMERTEST_REARM_AT  12      // ...to this many ticks
+
+// ============== PS ==============
+void cmd_ps(const char* args) {
+    (void)args;
+    task_list();
+}
+
+// ============== SPAWN ==============
+// Short-lived worker: sleeps in small steps, then exits and is reaped
+static void spawn_worker(void) {
+    for (int i = 0; i < SPAWN_LIFETIME / 10; i++) {
+        task_sleep(10);
+    }
+}
+
+static const char* parse_uint(const char* s, uint32_t* out) {
+    uint32_t v = 0;
+    int digits = 0;
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (uint32_t)(*s++ - '0');
+        digits++;
+    }
+    while (*s == ' ') s++;
+    if (digits) *out = v;
+    return s;
+}
+
+void cmd_spawn(const char* args) {
+    uint32_t count = 0;
+    uint32_t stack = SPAWN_DEFAULT_STACK;
+
+    args = parse_uint(args, &count);
+    parse_uint(args, &stack);
+
+    if (count == 0) {
+        uart_puts("Usage: spawn <count> [stack bytes]\n");
+        return;
+    }
+
+    uint32_t created = 0;
+    for (; created < count; created++) {
+        if (task_create_sized("worker", spawn_worker, 1, TASK_CPU_ANY, stack) < 0) {
+            break;
+        }
+    }
+
+    uart_puts("Spawned ");
+    uart_putdec(created);
+    uart_puts(" tasks, ");
+    uart_putdec(task_count());
+    uart_puts(" live\n");
+}
+
+// ============== FPUTEST ==============
+// Two tasks on one core keep distinct patterns in d0-d31 across switches
+static void fpu_worker(uint32_t pattern) {
+    uint32_t errors = 0;
+
+    for (int i = 0; i < FPUTEST_ROUNDS; i++) {
+        fpu_fill(pattern);
+        task_sleep(1);
+        if (fpu_verify(pattern) != 0) {
+            errors++;
+        }
+    }
+
+    uart_puts("fputest: pattern ");
+    uart_puthex(pattern);
+    uart_puts(errors ? " CORRUPTED in " : " intact over ");
+    uart_putdec(errors ? errors : FPUTEST_ROUNDS);
+    uart_puts(" rounds\n");
+}
+
+static void fpu_worker_a(void) { fpu_worker(0x11111111); }
+static void fpu_worker_b(void) { fpu_worker(0x22222222); }
+
+void cmd_fputest(const char* args) {
+    (void)args;
+
+    uint32_t cpu = task_current() ? task_current()->cpu : 0;
+    task_create_sized("fpu-a", fpu_worker_a, 1, cpu, 1024);
+    task_create_sized("fpu-b", fpu_worker_b, 1, cpu, 1024);
+}
+
+// ============== TIMERTEST ==============
+// Callback timers: each fires once, on time, in the "timers" task; a
+// cancelled one (either cancel) never fires and a re-armed one fires at
+// its new time
+static const uint32_t timertest_ticks[TIMERTEST_COUNT] = { 1, 2, 7, 31, 32, 100 };
+static Timer timertest_timers[TIMERTEST_COUNT];
+static volatile uint32_t timertest_fired[TIMERTEST_COUNT];
+static volatile uint32_t timertest_at[TIMERTEST_COUNT];
+static volatile uint32_t timertest_wrong_task;
+
+static void timertest_fire(void* arg) {
+    uint32_t i = (uint32_t)(uintptr_t)arg;
+    timertest_fired[i]++;
+    timertest_at[i] = timer_ticks;
+    if (!str_startswith(task_current()->name, "timers")) {
+        timertest_wrong_task++;
+    }
+}
+
+void cmd_timertest(const char* args) {
+    (void)args;
+
+    if (!task_current()) {
+        uart_puts("timertest: needs the scheduler\n");
+        return;
+    }
+
+    uint32_t due[TIMERTEST_COUNT];
+    uint32_t errors = 0;
+
+    timertest_wrong_task = 0;
+    uint32_t start = timer_ticks;
+    for (uint32_t i = 0; i < TIMERTEST_COUNT; i++) {
+        timertest_fired[i] = 0;
+        due[i] = timertest_ticks[i];
+        timer_add(&timertest_timers[i], timertest_fire, (void*)(uintptr_t)i, due[i]);
+    }
+    timer_add(&timertest_timers[TIMERTEST_REARM], timertest_fire,
+              (void*)(uintptr_t)TIMERTEST_REARM, TIMERTEST_REARM_AT);
+    due[TIMERTEST_REARM] = TIMERTEST_REARM_AT;
+    if (timer_cancel(&timertest_timers[TIMERTEST_CANCEL]) != 1) {
+        uart_puts("timertest: cancel missed a pending timer\n");
+        errors++;
+    }
+
+    task_sleep(timertest_ticks[TIMERTEST_COUNT - 1] + TIMERTEST_SLACK + 1);
+
+    for (uint32_t i = 0; i < TIMERTEST_COUNT; i++) {
+        uint32_t late = timertest_at[i] - start - due[i];
+        int ok;
+        if (i == TIMERTEST_CANCEL) {
+            ok = timertest_fired[i] == 0;
+        } else {
+            ok = timertest_fired[i] == 1 && late <= TIMERTEST_SLACK;
+        }
+        if (!ok) {
+            uart_puts("timertest: timer ");
+            uart_putdec(i);
+            uart_puts(" fired ");
+            uart_putdec(timertest_fired[i]);
+            uart_puts("x, due +");
+            uart_putdec(due[i]);
+            uart_puts(" ticks\n");
+            errors++;
+        }
+    }
+    if (timer_cancel(&timertest_timers[0]) != 0 || timer_cancel_sync(&timertest_timers[1]) != 0) {
+        uart_puts("timertest: cancel claimed a fired timer\n");
+        errors++;
+    }
+    timer_add(&timertest_timers[0], timertest_fire, (void*)0, 1);
+    if (timer_cancel_sync(&timertest_timers[0]) != 1) {
+        uart_puts("timertest: sync cancel missed a pending timer\n");
+        errors++;
+    }
+    task_sleep(TIMERTEST_SLACK + 1);
+    if (timertest_fired[0] != 1) {
+        uart_puts("timertest: sync-cancelled timer fired\n");
+        errors++;
+    }
+    if (timertest_wrong_task) {
+        uart_puts("timertest: callback ran outside the timers task\n");
+        errors++;
+    }
+
+    uart_puts(errors ? "timertest: FAILED\n" : "timertest: passed\n");
+}
+
+// ============== RT ==============
+// Load tasks from `rt add`: each job spins for rt_work us, the value
+// given to the latest `rt add`
+static volatile uint32_t rt_work;
+static volatile int rt_stop;
+
+static void rt_load_job(void) {
+    if (rt_stop) {
+        task_exit();
+    }
+    uint32_t start = *SYSTIMER_CLO;
+    while (*SYSTIMER_CLO - start < rt_work);
+}
+
+void cmd_rt(const char* args) {
+    if (str_startswith(args, "add")) {
+        uint32_t period = 0, budget = 0, work = 0, deadline = 0;
+        args = parse_uint(str_skip_spaces(args + 3), &period);
+        args = parse_uint(args, &budget);
+        args = parse_uint(args, &work);
+        parse_uint(args, &deadline);
+        if (period == 0 || budget == 0) {
+            uart_puts("Usage: rt add <period us> <budget us> <work us> [deadline us]\n");
+            return;
+        }
+        rt_work = work;
+        rt_stop = 0;
+        task_create_periodic("rt-load", rt_load_job, period, budget, deadline);
+        return;
+    }
+    if (str_startswith(args, "stop")) {
+        rt_stop = 1;            // Each load task exits at its next release
+        return;
+    }
+    task_rt_list();
+}
+
+void cmd_task_init(void) {
+    register_command("ps", "ps", "List tasks and their cores", cmd_ps);
+    register_command("spawn", "spawn", "Start short-lived tasks: <n> [stack]", cmd_spawn);
+    register_command("fputest", "fputest", "Check lazy VFP/NEON switching", cmd_fputest);
+    register_command("timertest", "timertest", "Check callback timers fire and cancel", cmd_timertest);
+    register_command("rt", "rt", "Periodic tasks: rt | rt add <p> <b> <w> [d] | rt stop", cmd_rt);
+}
@@ -0,0 +1,14 @@
+#ifndef CMD_TASK_H
+#define CMD_TASK_H
+
+// Command handlers
+void cmd_ps(const char* args);
+void cmd_spawn(const char* args);
+void cmd_fputest(const char* args);
+void cmd_timertest(const char* args);
+void cmd_rt(const char* args);
+
+// Register task commands
+void cmd_task_init(void);
+
+#endif
@@ -2,7 +2,7 @@
 #define COMMANDS_H
 
 
-#define MAX_COMMANDS 32
+#define MAX_COMMANDS CONFIG_MAX_COMMANDS
 
 // Command handler function type
 typedef void (*CommandHandler)(const char* args);
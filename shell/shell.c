@@ -16,8 +16,10 @@
 // Include command modules here
 #include "commands/cmd_system.h"
 #include "commands/cmd_fs.h"
+#include "commands/cmd_bench.h"
+#include "commands/cmd_task.h"
+#include "commands/cmd_mem.h"
 // #include "commands/cmd_files.h"    // Add when ready
-// #include "commands/cmd_task.h"     // Add when ready
 
 /*
  * Register all commands
@@ -25,9 +27,15 @@
  */
 static void all_commands_init(void) {
     cmd_system_init();      // help, info, uptime, clear, reboot
-    cmd_fs_init();
+#if CONFIG_FATFS
+    cmd_fs_init();          // ls, cat, touch, write, rm, mkdir
+#endif
+#if CONFIG_BENCH
+    cmd_bench_init();       // bench
+#endif
+    cmd_task_init();        // ps, spawn, fputest, timertest, rt
+    cmd_mem_init();         // meminfo, heapinfo, slabinfo, kmtest
     // cmd_files_init();    // ls, cat, touch, rm, write, edit
-    // cmd_task_init();     // ps, kill
 }
 
 void shell_init(void) {
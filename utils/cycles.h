@@ -0,0 +1,38 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+
+// PMU cycle counter of the calling core; call cycles_enable() once per
+// core before reading it
+#ifdef __aarch64__
+static inline uint32_t cycles(void) {
+    uint64_t c;
+    __asm__ __volatile__("mrs %0, pmccntr_el0" : "=r"(c));
+    return (uint32_t)c;
+}
+
+static inline void cycles_enable(void) {
+    uint64_t pmcr;
+    __asm__ __volatile__("mrs %0, pmcr_el0" : "=r"(pmcr));
+    __asm__ __volatile__("msr pmcr_el0, %0" :: "r"(pmcr | 1));                  // PMCR.E
+    __asm__ __volatile__("msr pmcntenset_el0, %0" :: "r"(1ul << 31));           // Cycle counter
+    __asm__ __volatile__("isb" ::: "memory");
+}
+#else
+static inline uint32_t cycles(void) {
+    uint32_t c;
+    __asm__ __volatile__("mrc p15, 0, %0, c9, c13, 0" : "=r"(c));
+    return c;
+}
+
+static inline void cycles_enable(void) {
+    uint32_t pmcr;
+    __asm__ __volatile__("mrc p15, 0, %0, c9, c12, 0" : "=r"(pmcr));
+    __asm__ __volatile__("mcr p15, 0, %0, c9, c12, 0" :: "r"(pmcr | 1));        // PMCR.E
+    __asm__ __volatile__("mcr p15, 0, %0, c9, c12, 1" :: "r"(1u << 31));        // PMCNTENSET.C
+    __asm__ __volatile__("isb" ::: "memory");
+}
+#endif
+
+#endif
@@ -1,6 +1,31 @@
 #include "string_utils.h"
+#include <stdint.h>
+
+// Word loads for the string scans. An aligned word never crosses a page,
+// so reading past the terminator inside it is safe.
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+#define ONES    0x01010101u
+#define HIGHS   0x80808080u
+#define HAS_ZERO(w)     (((w) - ONES) & ~(w) & HIGHS)
 
 int str_cmp(const char* s1, const char* s2) {
+    // Bytes until s1 is aligned; words only if s2 then is too
+    while (((uintptr_t)s1 & 3) && *s1 && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    if (!((uintptr_t)s1 & 3) && !((uintptr_t)s2 & 3)) {
+        const word_t* w1 = (const word_t*)s1;
+        const word_t* w2 = (const word_t*)s2;
+        while (*w1 == *w2 && !HAS_ZERO(*w1)) {
+            w1++;
+            w2++;
+        }
+        s1 = (const char*)w1;
+        s2 = (const char*)w2;
+    }
+
     while (*s1 && (*s1 == *s2)) {
         s1++;
         s2++;
@@ -25,9 +50,25 @@ const char* str_skip_spaces(const char* str) {
 }
 
 int str_len(const char* s) {
-    int len = 0;
-    while (*s++) len++;
-    return len;
+    const char* p = s;
+
+    while ((uintptr_t)p & 3) {
+        if (!*p) {
+            return p - s;
+        }
+        p++;
+    }
+
+    const word_t* w = (const word_t*)p;
+    while (!HAS_ZERO(*w)) {
+        w++;
+    }
+
+    p = (const char*)w;
+    while (*p) {
+        p++;
+    }
+    return p - s;
 }
 
 void str_copy(char* dst, const char* src, int max) {
@@ -64,30 +105,4 @@ char *strchr(const char *s, int c) {
     return 0;
 }
 
-int memcmp(const void *s1, const void *s2, size_t n) {
-    const unsigned char *a = s1;
-    const unsigned char *b = s2;
-
-    while (n--) {
-        if (*a != *b)
-            return *a - *b;
-        a++;
-        b++;
-    }
-    return 0;
-}
-
-// memcpy: copy n bytes from src to dest
-void *memcpy(void *dest, const void *src, size_t n) {
-    unsigned char *d = dest;
-    const unsigned char *s = src;
-    while (n--) *d++ = *s++;
-    return dest;
-}
-
-// memset: fill n bytes of s with c
-void *memset(void *s, int c, size_t n) {
-    unsigned char *p = s;
-    while (n--) *p++ = (unsigned char)c;
-    return s;
-}
\ No newline at end of file
+// memcpy, memset and memcmp live in mem_arm.S